@@ -0,0 +1,214 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+/**
+ * Host simulation of link state flooding with multipoint relays.
+ *
+ * A network of 50 link_state routers is placed on a 100x100 square, nodes within a radius of 30 are neighbours.
+ * The connectivity adapters deliver every transmission instantly and without loss, so only the routing logic is simulated.
+ * Nodes join one at a time, the routing transmissions until the network converged are printed.
+ * After that, node 1 floods an update a few times. Printed per flood are the amount of UPDATE transmissions
+ * and the amount of nodes reached, next to the amount a flood would take without multipoint relays:
+ * every node passing the update on to all of its neighbours, which is the sum of all degrees.
+ *
+ * Positions come from srand/rand with a fixed seed, the numbers in the history of this library were measured with glibc.
+ */
+
+#include <mesh/router/link_state_router.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <set>
+#include <vector>
+
+using mesh::node_id;
+
+namespace {
+    constexpr size_t node_count = 50;
+    constexpr double radius = 30;
+
+    struct frame {
+        node_id receiver;
+        std::vector<uint8_t> data;
+    };
+
+    /// Frames that were transmitted, but not received yet
+    std::deque<frame> air;
+    /// Transmissions per message type
+    long transmissions[256] = {};
+
+    /**
+     * \brief Connectivity adapter that delivers directly to the simulated air, connected to a fixed set of neighbours
+     */
+    class simulated_adapter : public mesh::connectivity_adapter, public mesh::transmit_listener {
+    public:
+        std::set<node_id> neighbours;
+
+        explicit simulated_adapter(node_id address) : connectivity_adapter(address) {
+            set_transmit_listener(*this);
+        }
+
+        bool start_transmit(node_id &id, uint8_t *data, size_t size) override {
+            transmissions[data[0]]++;
+            air.push_back({id, std::vector<uint8_t>(data, data + size)});
+            return true;
+        }
+
+        mesh::transmit_status poll_transmit() override {
+            return mesh::TRANSMIT_SUCCESS;
+        }
+
+        void on_transmit_complete(const node_id &, const mesh::message_type &, bool) override {}
+
+        bool has_frame() override {
+            return false;
+        }
+
+        mesh::message_view next_frame() override {
+            return {};
+        }
+
+        mesh::mesh_connection_state connection_state(const node_id &id) override {
+            return neighbours.count(id) ? mesh::ACCEPTED : mesh::DISCONNECTED;
+        }
+
+        size_t get_neighbour_count() override {
+            return neighbours.size();
+        }
+
+        void get_neighbours(uint8_t data[]) override {
+            size_t i = 0;
+            for (node_id neighbour : neighbours) {
+                data[i++] = neighbour;
+            }
+        }
+
+        bool discovery_present_received(mesh::message &) override {
+            return false;
+        }
+
+        bool discovery_respond_received(mesh::message &) override {
+            return false;
+        }
+
+        void discovery_accept_received(mesh::message &) override {}
+
+        void remove_direct_connection(const uint8_t &) override {}
+
+        void status() override {}
+    };
+
+    struct node {
+        std::unique_ptr<simulated_adapter> adapter;
+        std::unique_ptr<mesh::routers::topology_pool<64, 24>> topology;
+        std::unique_ptr<mesh::routers::link_state> router;
+    };
+
+    std::vector<node> nodes(node_count + 1);
+    /// Nodes that received the update of node 1 during the current flood
+    std::set<node_id> reached;
+
+    /**
+     * \brief Let every router update, then deliver frames until the air is quiet
+     */
+    void run(int ticks) {
+        for (int tick = 0; tick < ticks; tick++) {
+            for (size_t i = 1; i <= node_count; i++) {
+                nodes[i].router->update();
+            }
+            for (int round = 0; round < 50; round++) {
+                for (size_t i = 1; i <= node_count; i++) {
+                    nodes[i].adapter->poll();
+                }
+                while (!air.empty()) {
+                    frame received = air.front();
+                    air.pop_front();
+                    mesh::message_view view(received.data.data(), received.data.size());
+                    node &receiver = nodes[received.receiver];
+                    mesh::message msg;
+                    view.copy_to(msg);
+                    if (!receiver.adapter->is_new_message(view)) { // Like mesh_network, a copy can still have to be passed on
+                        receiver.router->on_duplicate_routing_message(msg);
+                        continue;
+                    }
+                    if (msg.receiver != 0 && msg.receiver != received.receiver) { // Relay a unicast message like mesh_network
+                        receiver.adapter->send(view, receiver.router->get_next_hop(msg.receiver));
+                        continue;
+                    }
+                    if (msg.sender == 1 && msg.type == mesh::LINK_STATE_ROUTING::UPDATE) {
+                        reached.insert(received.receiver);
+                    }
+                    receiver.router->on_routing_message(msg);
+                }
+            }
+        }
+    }
+}
+
+int main() {
+    srand(7);
+    double x[node_count + 1], y[node_count + 1];
+    for (size_t i = 1; i <= node_count; i++) {
+        x[i] = rand() % 100;
+        y[i] = rand() % 100;
+    }
+
+    long degree_sum = 0;
+    for (size_t i = 1; i <= node_count; i++) {
+        nodes[i].adapter = std::make_unique<simulated_adapter>(i);
+        for (size_t j = 1; j <= node_count; j++) {
+            if (i != j && std::hypot(x[i] - x[j], y[i] - y[j]) < radius) {
+                nodes[i].adapter->neighbours.insert(j);
+            }
+        }
+        degree_sum += nodes[i].adapter->neighbours.size();
+        nodes[i].topology = std::make_unique<mesh::routers::topology_pool<64, 24>>();
+        nodes[i].router = std::make_unique<mesh::routers::link_state>(*nodes[i].adapter, *nodes[i].topology);
+    }
+    printf("%zu nodes, %.1f neighbours on average\n", node_count, double(degree_sum) / node_count);
+
+    // Nodes join one tick apart, like they would after their connection handshakes.
+    // Starting all of them at once overflows the transmit queues, and lost updates are only repaired when neighbours change
+    for (size_t i = 1; i <= node_count; i++) {
+        nodes[i].router->initial_update();
+        run(1);
+    }
+    run(300);
+    long joining = 0;
+    for (uint8_t type = mesh::LINK_STATE_ROUTING::UPDATE_REQUEST; type <= mesh::LINK_STATE_ROUTING::MPR_SELECT; type++) {
+        joining += transmissions[type];
+    }
+    printf("joining: %ld routing transmissions\n", joining);
+
+    size_t complete = 0;
+    for (size_t i = 1; i <= node_count; i++) {
+        size_t routes = 0;
+        for (size_t j = 1; j <= node_count; j++) {
+            if (i != j && nodes[i].router->get_next_hop(j) != 0) {
+                routes++;
+            }
+        }
+        if (routes == node_count - 1) {
+            complete++;
+        }
+    }
+    printf("converged: %zu/%zu nodes have a route to every other node\n", complete, node_count);
+
+    for (int flood = 0; flood < 3; flood++) {
+        reached.clear();
+        long before = transmissions[mesh::LINK_STATE_ROUTING::UPDATE];
+        nodes[1].router->send_update();
+        run(3);
+        printf("flood %d: %ld transmissions (%ld without multipoint relays), reached %zu/%zu nodes\n", flood + 1,
+               transmissions[mesh::LINK_STATE_ROUTING::UPDATE] - before, degree_sum, reached.size(), node_count - 1);
+    }
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+/**
+ * Host benchmark of the link state topology: memory use and calculation time per pool size.
+ *
+ * Every pool is filled with a random geometric network (nodes on a square, connected to their nearest neighbours),
+ * which is how the radio networks this library is meant for look like.
+ * Measured are:
+ * - The size of the pool, split in the storage per node and the fixed lookup tables (see topology_pool)
+ * - Convergence after a node (re)connects: applying the edges of every node once, both on every change and deferred with a single recalculate
+ * - A single changed link cost, which is what most updates in a running network are
+ * - Calculating the backup hops
+ */
+
+#include <mesh/router/link_state_topology.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using mesh::node_id;
+using mesh::routers::link_state_topology;
+using mesh::routers::topology_pool;
+
+namespace {
+    struct network {
+        std::vector<std::vector<node_id>> edges;
+        std::vector<std::vector<uint8_t>> costs;
+    };
+
+    /**
+     * \brief Connect every node to its closest neighbours, links are symmetric and at most max_edges per node
+     */
+    network make_network(size_t node_count, size_t max_edges, std::mt19937 &random) {
+        std::uniform_real_distribution<double> position(0, 100);
+        std::vector<double> x(node_count + 1), y(node_count + 1);
+        for (size_t i = 1; i <= node_count; i++) {
+            x[i] = position(random);
+            y[i] = position(random);
+        }
+        x[1] = y[1] = 50; // The benchmarked node is in the middle
+
+        network result;
+        result.edges.resize(node_count + 1);
+        result.costs.resize(node_count + 1);
+        // Aim for an average degree of about 3/4 of the edge capacity, nodes in dense spots are capped at max_edges
+        double radius = 100 * std::sqrt(double(max_edges) * 0.75 / (3.14159 * double(node_count))) + 5;
+        std::uniform_int_distribution<int> cost(10, 30);
+        for (size_t i = 1; i <= node_count; i++) {
+            for (size_t j = i + 1; j <= node_count; j++) {
+                if (std::hypot(x[i] - x[j], y[i] - y[j]) > radius ||
+                    result.edges[i].size() >= max_edges || result.edges[j].size() >= max_edges) {
+                    continue;
+                }
+                uint8_t link_cost = uint8_t(cost(random));
+                result.edges[i].push_back(node_id(j));
+                result.costs[i].push_back(link_cost);
+                result.edges[j].push_back(node_id(i));
+                result.costs[j].push_back(link_cost);
+            }
+        }
+        return result;
+    }
+
+    void apply_all(link_state_topology &topology, const network &net) {
+        for (size_t i = 1; i < net.edges.size(); i++) {
+            topology.set_edges(node_id(i), net.edges[i].data(), net.costs[i].data(), net.edges[i].size());
+        }
+    }
+
+    template<typename F>
+    double average_us(size_t runs, F &&function) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < runs; i++) {
+            function(i);
+        }
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / double(runs);
+    }
+
+    template<size_t max_nodes, size_t max_edges>
+    void benchmark(std::mt19937 &random) {
+        static topology_pool<max_nodes, max_edges> topology;
+        network net = make_network(max_nodes, max_edges, random);
+
+        size_t reachable = 0;
+        topology.reset(1);
+        apply_all(topology, net);
+        for (size_t i = 2; i <= max_nodes; i++) {
+            if (topology.get_next_hop(node_id(i)) != 0) {
+                reachable++;
+            }
+        }
+
+        const size_t runs = 20;
+        double immediate = average_us(runs, [&](size_t) {
+            topology.reset(1);
+            apply_all(topology, net);
+        });
+        double deferred = average_us(runs, [&](size_t) {
+            topology.reset(1);
+            topology.set_deferred(true);
+            apply_all(topology, net);
+            topology.set_deferred(false);
+        });
+
+        // Change the cost of a random link back and forth, in both directions
+        std::uniform_int_distribution<size_t> pick(1, max_nodes);
+        std::uniform_int_distribution<int> cost(10, 30);
+        double single = average_us(runs * 50, [&](size_t) {
+            size_t node = pick(random);
+            std::vector<uint8_t> costs = net.costs[node];
+            if (costs.empty()) {
+                return;
+            }
+            costs[pick(random) % costs.size()] = uint8_t(cost(random));
+            topology.set_edges(node_id(node), net.edges[node].data(), costs.data(), costs.size());
+        });
+
+        double backups = average_us(runs, [&](size_t i) {
+            // Toggle a link of this node, so the backups are outdated every run
+            std::vector<uint8_t> costs = net.costs[1];
+            if (!costs.empty()) {
+                costs[0] = uint8_t(costs[0] + (i % 2));
+            }
+            topology.set_edges(1, net.edges[1].data(), costs.data(), costs.size());
+            topology.update_backups();
+        });
+
+        size_t per_node = 2 * max_edges + sizeof(link_state_topology::topology_node);
+        std::printf("%4zu nodes %3zu edges | %6zu B (%4zu B per node + %4zu B) | %3zu/%3zu reachable | "
+                    "all edges %8.1f us, deferred %7.1f us | cost change %5.2f us | backups %7.1f us\n",
+                    max_nodes, max_edges, sizeof(topology), per_node, sizeof(topology) - max_nodes * per_node,
+                    reachable, max_nodes - 1, immediate, deferred, single, backups);
+    }
+}
+
+int main() {
+    std::mt19937 random(2019);
+    benchmark<25, 4>(random);
+    benchmark<50, 8>(random);
+    benchmark<100, 8>(random);
+    benchmark<100, 16>(random);
+    benchmark<250, 8>(random);
+    benchmark<250, 16>(random);
+    return 0;
+}
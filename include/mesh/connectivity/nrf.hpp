@@ -11,7 +11,9 @@
 #define IPASS_MESH_NRF_CONNECTIVITY_HPP
 
 #include <nrf24l01plus/nrf24l01plus.hpp>
+#include <atomic>
 #include <mesh/connectivity_adapter.hpp>
+#include <mesh/spsc_ring.hpp>
 #include <mesh/connectivity/nrf_pipe.hpp>
 
 namespace mesh {
@@ -21,21 +23,87 @@ namespace mesh {
          * @{
          */
 
+        /**
+         * \brief A single frame, as it was read from the NRF module
+         */
+        struct nrf_frame {
+            uint8_t size = 0;
+            std::array<uint8_t, 32> bytes = {0};
+        };
+
         /**
          * \brief NRF Connectivity adapter
          *
          * New NRF addresses are created by checking for unused pipes starting at the node_id incrementing by 2.
          * For this reason, nodes in an NRF mesh network should always be at least 12 node_id's apart
+         *
+         * Received frames are stored in an spsc_ring, provided by the user. Frames are read from the module when a frame is requested,
+         * and, when handle_irq is called from the interrupt handler of the module's IRQ pin, as soon as they arrive.
+         * The latter prevents the module's 3-frame RX FIFO from overflowing while the main loop is busy.
          */
         class nrf : public mesh::connectivity_adapter {
+            static_assert(message::max_size <= 32, "The message layout doesn't fit in a single NRF24L01+ frame");
+            static_assert(message::connection_data_size >= 1, "NRF needs a byte of connection data for discovery");
+
         private:
-            std::array<message, 100> message_buffer = {};
-            size_t buffer_start = 0;
-            size_t buffer_end = 0;
+            /**
+             * \brief Marks the SPI bus as used by the main context, for as long as it exists
+             *
+             * When handle_irq is called while the bus is used, it postpones reading frames until the guard is destroyed.
+             * Guards can be nested, only the outermost one releases the bus.
+             */
+            struct spi_guard {
+                nrf &owner;
+                bool outer;
+
+                explicit spi_guard(nrf &owner);
 
+                ~spi_guard();
+            };
+
+            spsc_ring<nrf_frame> &receive_buffer;
+            /// True when the front frame of receive_buffer was returned by next_frame, it is popped on the next call
+            bool frame_taken = false;
+            overflow_policy receive_overflow = OVERFLOW_KEEP;
+            /// True while frames are kept in the NRF module because the receive buffer is full, so this is only counted once
+            bool receive_stalled = false;
+            hwlib::pin_in *irq_pin = nullptr;
+            std::atomic<bool> spi_busy{false};
+            std::atomic<bool> irq_pending{false};
 
             std::array<nrf_pipe, 6> connections;
+            /// Pipe that is currently transmitting, 6 if none
+            uint8_t transmit_pipe = 6;
+            /// Pipe whose address is still swapped into pipe 0 after transmitting, 6 if none
+            uint8_t restore_pipe = 6;
+            /// Mode to restore when the transmit queue is idle
+            uint8_t transmit_old_mode = 0;
+            /// Time at which the oldest payload in the TX FIFO started transmitting
+            uint_fast64_t transmit_start = 0;
+            /// Amount of payloads written to the TX FIFO that haven't been reported yet
+            uint8_t transmit_count = 0;
+            /// Amount of those payloads that are known to be sent
+            uint8_t transmit_done = 0;
+            /// True if a payload failed, it is reported after the transmit_done payloads before it
+            bool transmit_failure = false;
+            /// Depth of the NRF module's TX FIFO
+            static constexpr const uint8_t tx_fifo_size = 3;
+            /// TX_EMPTY bit of the FIFO_STATUS register, set when the TX FIFO holds no payloads
+            static constexpr const uint8_t fifo_tx_empty = 0x10;
+            /**
+             * Maximum amount of payloads in the TX FIFO at once.
+             * The module only signals "empty" and "full", so with 3 payloads, 1 or 2 remaining can't be told apart.
+             * With at most 2, TX_DS and TX_EMPTY together give the exact amount of sent payloads.
+             */
+            static constexpr const uint8_t max_transmit_payloads = tx_fifo_size - 1;
+            /// Attempts the NRF module makes per payload: the first one, plus the automatic retransmits set in SETUP_RETR
+            static constexpr const uint8_t max_hardware_attempts = 11;
+            /// Attempts used by the payloads reported by the last poll_transmit
+            uint8_t last_attempts = 1;
+            /// Time after which a transmission that didn't finish is considered failed. The maximum retransmit time is 15 * 4000us
+            static constexpr const uint_fast64_t transmit_timeout_us = 100000;
             nrf24l01::nrf24l01plus &nrf24;
+            nrf_register_cache registers;
             const nrf24l01::address discovery_address = {0x70, 0x70, 0x70, 0x70, 0x70};
             const nrf24l01::address base_address = {0x72, 0x72, 0x72, 0x72, 0x70};
 
@@ -65,9 +133,28 @@ namespace mesh {
 
             /**
              * \brief Buffer received messages to prevent FIFO overflow in the NRF module
+             *
+             * Called from the main context. When an IRQ pin is set, the module is only read when the pin is active.
              */
             void buffer_messages();
 
+            /**
+             * \brief Move all frames from the NRF module's RX FIFO to the receive buffer
+             *
+             * Payloads are read from the NRF module directly into the buffer, they are not copied again until they are used.
+             * The slot of the last frame returned by next_frame isn't popped yet, so its view stays valid.
+             * When the buffer is full, the overflow policy decides if the remaining payloads are left in the NRF module's FIFO, or dropped.
+             * The caller should hold the SPI bus.
+             */
+            void drain_rx();
+
+            /**
+             * \brief Mark the transmission as finished after the last payload in the TX FIFO was reported
+             *
+             * The pipes and mode are not restored yet, so a next transmission to the same node doesn't need to swap them again.
+             */
+            void end_transmit();
+
 
         public:
             /**
@@ -75,8 +162,36 @@ namespace mesh {
              *
              * @param address Address of this node
              * @param nrf NRF module to use
+             * @param receive_buffer Buffer to store received frames in, for example an spsc_ring_buffer<nrf_frame, 32>
              */
-            nrf(const node_id &address, nrf24l01::nrf24l01plus &nrf);
+            nrf(const node_id &address, nrf24l01::nrf24l01plus &nrf, spsc_ring<nrf_frame> &receive_buffer);
+
+            /**
+             * \brief Use the NRF module's IRQ pin to check if there is anything to read
+             *
+             * When the pin is inactive (high), checking for frames doesn't use the SPI bus.
+             * This doesn't install an interrupt handler, call handle_irq from one to read frames as soon as they arrive.
+             * @param pin The IRQ pin of the NRF module
+             */
+            void set_irq_pin(hwlib::pin_in &pin);
+
+            /**
+             * \brief Set what happens with received frames when the receive buffer is full
+             *
+             * With OVERFLOW_KEEP (default), frames are left in the NRF module, which stops acknowledging new frames when its FIFO is full, so senders retry.
+             * With OVERFLOW_DROP, frames are read and discarded.
+             * The receive buffer's overflow count is incremented for every dropped frame, or when frames are first kept in the module.
+             * @param policy The overflow policy
+             */
+            void set_overflow_policy(overflow_policy policy);
+
+            /**
+             * \brief Read all received frames from the NRF module into the receive buffer
+             *
+             * Can be called from the interrupt handler of the NRF module's IRQ pin.
+             * If the interrupt happens while the adapter itself uses the SPI bus, reading is postponed until the adapter is done.
+             */
+            void handle_irq();
 
 
         private:
@@ -90,33 +205,71 @@ namespace mesh {
 
         protected:
             /**
-             * \brief send implementation for NRF
+             * \brief Start transmission for NRF
              *
+             * The first transmission swaps the pipe addresses (unless they are still swapped for the same node), later transmissions to the same node are only written to the TX FIFO.
+             * This way the module sends consecutive frames without waiting for a poll in between.
              * @param id Node_id to send to
              * @param data Pointer to data to be sent
              * @param size Size of the data to be sent
-             * @return True if transmission was successful (and autoACK'ed)
+             * @return False if no pipe is connected to id, or the TX FIFO is in use for another node, full, or has a failed payload
              */
-            bool send_implementation(node_id &id, uint8_t *data, size_t size) override;
+            bool start_transmit(node_id &id, uint8_t *data, size_t size) override;
 
-        public:
+            /**
+             * \brief Check the status of the oldest payload in the TX FIFO
+             *
+             * Sent payloads leave the TX FIFO, so their amount follows from the FIFO occupancy: all of them when TX_EMPTY is set,
+             * otherwise one less than the payloads written when TX_DS is set (see max_transmit_payloads), and none otherwise.
+             * Payloads that were sent before a failing one are reported as sent first, then the failure is reported.
+             * The pipes and mode are restored in transmit_idle, once there is nothing left to send.
+             * A transmission that doesn't finish in time (for example because the module's mode was changed) fails.
+             * When a payload fails, the payloads after it are flushed as well.
+             * @return TRANSMIT_SUCCESS if the oldest payload was sent (and autoACK'ed)
+             */
+            transmit_status poll_transmit() override;
 
             /**
-             * \brief Checks if a message is available
+             * \brief Use the NRF module's TX FIFO to have multiple frames in flight
+             * @return max_transmit_payloads
+             */
+            size_t transmit_window() override;
+
+            /**
+             * \brief Get the attempts used for the last reported payload
+             *
+             * Read from the ARC_CNT field of OBSERVE_TX. Failed payloads used all max_hardware_attempts attempts.
+             * @return The amount of attempts
+             */
+            uint8_t transmit_attempts() override;
+
+            /**
+             * \brief Restore the pipe addresses and mode after transmitting
              *
-             * This method fills the buffer with new messages from the NRF module, then checks if the buffer has messages available.
+             * This is postponed until the transmit queue is idle, so consecutive frames to a node don't reconfigure the module.
+             * Pipe 0 doesn't receive broadcasts until this is done.
+             */
+            void transmit_idle() override;
+
+            /**
+             * \brief Checks if a frame is available
+             *
+             * This method fills the buffer with new frames from the NRF module, then checks if the buffer has frames available.
              * It does this to prevent NRF module FIFO buffer overflow
-             * @return True if a message is available in buffer
+             * @return True if a frame is available in buffer
              */
-            bool has_message() override;
+            bool has_frame() override;
 
             /**
-             * \brief Retrieves the first message from buffer
+             * \brief Retrieves the first frame from buffer
              *
-             * This method also fills the buffer with new messages first
-             * @return The first message available (in FIFO order)
+             * This method also fills the buffer with new frames first
+             * The returned view points into the buffer, and stays valid until the next call to next_frame.
+             * @return View of the first frame available (in FIFO order)
              */
-            mesh::message next_message() override;
+            mesh::message_view next_frame() override;
+
+        public:
 
             /**
              * \brief Get connection state for node_id
@@ -183,10 +336,11 @@ namespace mesh {
              * \brief Add NRF-specific data to messages that are to be sent
              *
              * For NRF this only needs to add NRF addresses to PRESENT and RESPOND messages
-             * @param message Message to add data to
+             * @param connection_data Connection data of the serialized message
+             * @param type Type of the message
              * @param next_hop Next hop of the message, not really necessary for NRF
              */
-            void add_connection_data(message &message, node_id &next_hop) override;
+            void add_connection_data(uint8_t connection_data[], const message_type &type, node_id &next_hop) override;
 
             /**
              * \brief Print NRF connection status message
@@ -16,6 +16,7 @@
 #include <nrf24l01plus/definitions.hpp>
 #include <mesh/definitions.hpp>
 #include <mesh/message.hpp>
+#include <mesh/connectivity/nrf_register_cache.hpp>
 
 namespace mesh {
     namespace connectivity {
@@ -31,6 +32,7 @@ namespace mesh {
          * Contains the connection state of a pipe.
          * A pipe with number 0 is assumed to be a broadcast pipe.
          * Buffers settings before sending them to an NRF module, to prevent keeping it busy for too long.
+         * Settings are written through an nrf_register_cache, so flushing settings that are already on the module costs nothing.
          */
         class nrf_pipe {
             mesh::mesh_connection_state connection_state = mesh::DISCONNECTED;
@@ -47,25 +49,45 @@ namespace mesh {
 
             /**
              * Flush the current settings to an nrf module
-             * @param nrf Nrf module to flush to.
+             *
+             * Nothing is written if the module already has these settings.
+             * @param nrf Register cache of the nrf module to flush to.
              */
-            void flush(nrf24l01::nrf24l01plus &nrf);
+            void flush(nrf_register_cache &nrf);
 
             /**
-             * \brief Transmit data using the NRF module
+             * \brief Start transmitting data using the NRF module
              *
-             * Since this function takes care of swapping pipe addresses, it needs to have information about all pipes.
+             * Swaps this pipe's address into pipe 0, so auto acknowledgements can be received, then writes the payload.
              * When the pipe number is 0 (broadcast pipe) the payload is written with NOACK, since having Auto acknowledgement on broadcast messages would not work with more than 2 nodes.
-             * When broadcasting, this method will return true as soon as the data is sent.
-             * When unicasting, this method only returns true when the data was acknowledged by the other module.
-             * @param all_pipes Array of all pipes currently used
-             * @param nrf NRF Module to send data through
+             * This method doesn't wait for the transmission, the owner of the NRF module checks its status, and calls finish_send when it is done.
+             * When the addresses are still swapped from a previous transmission, no pipe settings are written.
+             * @param nrf Register cache of the NRF Module to send data through
              * @param n Size of data to send
              * @param data Data to send
-             * @return True if the data was sent (and possibly acknowledged) successfully, false otherwise
              */
-            bool send_message(std::array<nrf_pipe, 6> &all_pipes, nrf24l01::nrf24l01plus &nrf, uint8_t n,
-                              uint8_t *data);
+            void start_send(nrf_register_cache &nrf, uint8_t n, uint8_t *data);
+
+            /**
+             * \brief Add a payload to a transmission started with start_send
+             *
+             * The payload is written to the NRF module's TX FIFO, and is sent as soon as the payloads before it have been sent.
+             * Make sure the TX FIFO isn't full.
+             * @param nrf Register cache of the NRF Module to send data through
+             * @param n Size of data to send
+             * @param data Data to send
+             */
+            void queue_send(nrf_register_cache &nrf, uint8_t n, uint8_t *data);
+
+            /**
+             * \brief Restore the pipe addresses after a transmission
+             *
+             * Since this function takes care of swapping pipe addresses back, it needs to have information about all pipes.
+             * This doesn't have to be called after every transmission, consecutive transmissions through the same pipe can share a single finish_send.
+             * @param all_pipes Array of all pipes currently used
+             * @param nrf Register cache of the NRF Module the data was sent through
+             */
+            void finish_send(std::array<nrf_pipe, 6> &all_pipes, nrf_register_cache &nrf);
 
             /**
              * \brief Change the connection state on this pipe
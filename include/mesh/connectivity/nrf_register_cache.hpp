@@ -0,0 +1,127 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_MESH_NRF_REGISTER_CACHE_HPP
+#define IPASS_MESH_NRF_REGISTER_CACHE_HPP
+
+#include <array>
+#include <nrf24l01plus/nrf24l01plus.hpp>
+
+namespace mesh {
+    namespace connectivity {
+        /**
+         * \addtogroup connectivity_adapters
+         * @{
+         */
+
+        /**
+         * \brief Shadow copy of the NRF module's pipe configuration
+         *
+         * Keeps track of the mode, the enabled pipes and the RX/TX addresses that were written to an NRF module.
+         * Writes that wouldn't change anything are skipped, which saves SPI transfers when the same pipe configuration is set up repeatedly.
+         * Registers are unknown until they are written for the first time, unknown registers are always written.
+         * All pipe and mode changes on the module should go through this class, otherwise call invalidate.
+         */
+        class nrf_register_cache {
+            nrf24l01::nrf24l01plus &nrf;
+
+            uint8_t current_mode = 0;
+            bool mode_known = false;
+            /// Bit i is set when pipe i is enabled
+            uint8_t enabled_pipes = 0;
+            /// Bit i is set when the enabled state of pipe i is known
+            uint8_t enabled_known = 0;
+            std::array<nrf24l01::address, 6> rx_addresses = {};
+            /// Bit i is set when the address of pipe i is known
+            uint8_t rx_address_known = 0;
+            nrf24l01::address tx_address = {};
+            bool tx_address_known = false;
+
+            /**
+             * \brief Compare two NRF addresses
+             * @return True if all bytes are equal
+             */
+            static bool same_address(const nrf24l01::address &a, const nrf24l01::address &b);
+
+        public:
+            /**
+             * \brief Create a register cache, with all registers unknown
+             * @param nrf NRF module to write to
+             */
+            explicit nrf_register_cache(nrf24l01::nrf24l01plus &nrf);
+
+            /**
+             * \brief Get the NRF module, for operations that aren't cached (payloads, FIFO's and status)
+             * @return The NRF module
+             */
+            nrf24l01::nrf24l01plus &radio();
+
+            /**
+             * \brief Set the mode of the NRF module, if it is different
+             * @param mode The new mode
+             */
+            void mode(uint8_t mode);
+
+            /**
+             * \brief Get the mode of the NRF module
+             *
+             * Only reads from the module if the mode isn't known.
+             * @return The mode
+             */
+            uint8_t get_mode();
+
+            /**
+             * \brief Enable or disable a receive pipe, if its state is different
+             * @param pipe Pipe number, 0-5
+             * @param enabled True to enable the pipe
+             */
+            void rx_enabled(uint8_t pipe, bool enabled);
+
+            /**
+             * \brief Set the receive address of a pipe, if it is different
+             * @param pipe Pipe number, 0-5
+             * @param address The new address
+             */
+            void rx_set_address(uint8_t pipe, const nrf24l01::address &address);
+
+            /**
+             * \brief Set the transmit address, if it is different
+             * @param address The new address
+             */
+            void tx_set_address(const nrf24l01::address &address);
+
+            /**
+             * \brief Check if a pipe is known to be in a given state
+             * @param pipe Pipe number, 0-5
+             * @param enabled Expected enabled state
+             * @param address Expected address, only checked when enabled is true
+             * @return True if the pipe is known to have this state, false if it differs or is unknown
+             */
+            bool rx_matches(uint8_t pipe, bool enabled, const nrf24l01::address &address) const;
+
+            /**
+             * \brief Check if the transmit address is known to be a given address
+             * @param address Expected address
+             * @return True if the address is known to be equal
+             */
+            bool tx_matches(const nrf24l01::address &address) const;
+
+            /**
+             * \brief Forget all cached registers, the next writes always go to the module
+             */
+            void invalidate();
+        };
+
+        /**
+         * @}
+         */
+    }
+}
+
+#endif //IPASS_MESH_NRF_REGISTER_CACHE_HPP
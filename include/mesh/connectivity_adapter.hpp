@@ -13,6 +13,16 @@
 #include <mesh/message.hpp>
 #include <mesh/definitions.hpp>
 
+/**
+ * \brief Maximum amount of other nodes a connectivity adapter keeps duplicate detection and link statistics for
+ *
+ * Defaults to 32. Every node costs 12 bytes per adapter, define MESH_MAX_NODES for the whole build to change it.
+ * It should be at least the amount of nodes in the network, see connectivity_adapter::is_new_message.
+ */
+#ifndef MESH_MAX_NODES
+#define MESH_MAX_NODES 32
+#endif
+
 namespace mesh {
     /**
      * \defgroup connectivity_adapters Mesh Connectivity Implementations
@@ -28,6 +38,26 @@ namespace mesh {
      */
 
 
+    /**
+     * \brief Interface for receiving the result of queued transmissions
+     *
+     * Since connectivity_adapter::send only queues messages, the result of a transmission is reported later, through this interface.
+     */
+    class transmit_listener {
+    public:
+        /**
+         * \brief Called when a queued message was sent, or when all attempts to send it have failed
+         *
+         * When a transmission to a next hop fails, all other messages queued for that next hop are dropped.
+         * Each of them is reported as failed as well, after the message that failed. Dropped coalesced messages are reported as a single TRANSPORT::BUNDLE.
+         * It is safe to queue new messages from this method.
+         * @param next_hop Node the message was sent to
+         * @param type Type of the message
+         * @param success True if the message was sent successfully, false otherwise
+         */
+        virtual void on_transmit_complete(const node_id &next_hop, const message_type &type, bool success) = 0;
+    };
+
     /**
      * \brief Base abstract class for connectivity, extend this to implement mesh_networking for a custom connection method
      *
@@ -35,9 +65,132 @@ namespace mesh {
      * This class also contains implemented methods for managing message history, and checking connection state before sending messages.
      */
     class connectivity_adapter {
-        uint16_t previous_messages[20] = {0};
-        uint8_t previous_messages_count = 0;
+    public:
+        /// Maximum amount of next hops that can have coalesced messages pending at the same time
+        static constexpr const size_t coalesce_buffer_count = 5;
+        /// Amount of traffic classes, see traffic_class
+        static constexpr const size_t traffic_class_count = 3;
+        /// Maximum amount of messages of a single traffic class waiting to be transmitted
+        static constexpr const size_t class_queue_size = 8;
+        /// Maximum amount of messages waiting to be transmitted, over all traffic classes
+        static constexpr const size_t transmit_queue_size = traffic_class_count * class_queue_size;
+        /// Amount of times a message is transmitted before it is considered failed
+        static constexpr const uint8_t max_transmit_attempts = 5;
+        /// Maximum amount of next hops a single queued send_all frame is sent to, more neighbours use multiple queue entries
+        static constexpr const size_t multicast_group_size = 6;
+        /// Maximum amount of frames an adapter can have in flight at the same time, see transmit_window
+        static constexpr const size_t max_transmit_window = 3;
+        /// Link cost of a neighbour that needs a single attempt for every frame, see link_cost
+        static constexpr const uint8_t link_cost_unit = 10;
+        /// Maximum amount of message types whose traffic class can be changed with set_traffic_class
+        static constexpr const size_t max_class_overrides = 4;
+        /// Maximum amount of other nodes that are remembered, see MESH_MAX_NODES
+        static constexpr const size_t max_nodes = MESH_MAX_NODES;
+
+    private:
+        /**
+         * \brief A serialized message, waiting in the transmit queue
+         *
+         * An entry is sent to its next hops one after another, the current next hop is always next_hops[0].
+         * An entry with alternatives is only sent to the first next hop that receives it, the other next hops are backups.
+         */
+        struct transmit_entry {
+            bool in_use = false;
+            /// Amount of next hops the entry still has to be sent to
+            uint8_t hop_count = 0;
+            std::array<node_id, multicast_group_size> next_hops = {0};
+            /// True if connection data should be added for every next hop before it is transmitted
+            bool patch_connection_data = false;
+            /// True if the next hops are alternatives: the entry is done once one of them received it
+            bool alternatives = false;
+            /// True while the entry was passed to start_transmit, and hasn't finished yet
+            bool in_flight = false;
+            message_type type = 0;
+            /// Traffic class of the queue the entry is in
+            traffic_class priority = CLASS_DATA;
+            /// Attempts for the current next hop
+            uint8_t attempts = 0;
+            /// Amount of polls to wait before the next attempt
+            uint8_t wait = 0;
+            /// Order in which the entry was queued
+            uint16_t sequence = 0;
+            size_t size = 0;
+            std::array<uint8_t, message::max_size> bytes = {0};
+        };
+
+        /**
+         * \brief Messages waiting to be sent to a single next hop in one TRANSPORT::BUNDLE frame
+         *
+         * Every message is stored in the bundle's payload as 1 byte of size, followed by the serialized message.
+         * A bundle is in use when its payload isn't empty. All messages in a bundle have the same traffic class.
+         */
+        struct coalesce_buffer {
+            message bundle;
+            traffic_class priority = CLASS_DATA;
+            uint16_t age = 0;
+        };
+
+        /**
+         * \brief Traffic class of a message type, set with set_traffic_class
+         */
+        struct class_override {
+            message_type type = 0;
+            traffic_class priority = CLASS_DATA;
+        };
+
+        /**
+         * \brief Smoothed transmission statistics of a neighbour
+         *
+         * Both values are exponentially weighted moving averages, in units of 1/256.
+         */
+        struct link_estimate {
+            /// Average amount of attempts (including hardware retransmits) per frame
+            uint16_t attempts = 256;
+            /// Average fraction of frames that were delivered
+            uint16_t delivered = 256;
+        };
+
+        /**
+         * \brief What the adapter remembers about another node
+         */
+        struct node_state {
+            /// Id of the node, 0 if the entry is unused
+            node_id id = 0;
+            /// Highest message id received from the node
+            uint8_t last_message_id = 0;
+            /// Value of node_clock when the entry was last used
+            uint16_t last_used = 0;
+            /// Bit i is set when message id (last_message_id - i) was received. 0 when nothing was received yet
+            uint32_t received_window = 0;
+            /// Link statistics, only used for neighbours
+            link_estimate link;
+        };
+
+        /// Nodes that messages were received from or sent to. When it is full, the least recently used node is replaced
+        std::array<node_state, max_nodes> nodes = {};
+        /// Incremented on every use of nodes, to find the least recently used one
+        uint16_t node_clock = 0;
+        uint8_t duplicate_window = 32;
         uint8_t current_message_id = 0;
+        /// Message types with a traffic class set by set_traffic_class, the first class_override_count are in use
+        std::array<class_override, max_class_overrides> class_overrides = {};
+        uint8_t class_override_count = 0;
+
+        std::array<coalesce_buffer, coalesce_buffer_count> coalesce_buffers = {};
+        size_t coalesce_threshold = 0;
+        uint16_t coalesce_deadline = 0;
+
+        uint8_t *bundle_cursor = nullptr;
+        size_t bundle_remaining = 0;
+
+        /// Queued messages, class_queue_size entries per traffic class, in order of priority
+        std::array<transmit_entry, transmit_queue_size> transmit_queue = {};
+        /// Entries passed to start_transmit, oldest first. All of them are sent to the same next hop
+        std::array<transmit_entry *, max_transmit_window> in_flight = {nullptr};
+        size_t in_flight_count = 0;
+        uint16_t next_sequence = 0;
+        bool polling = false;
+        transmit_listener *listener = nullptr;
     protected:
 
         /**
@@ -52,24 +205,214 @@ namespace mesh {
         /**
          * \brief Adds any connection-method specific data.
          *
-         * Each message had a 2-byte space for connection-method specific data (like RF channels).
+         * Each message has message::connection_data_size bytes of space for connection-method specific data (like RF channels), at the end of the serialized message.
          * This information should be added here. If connection specific data is not necessary, this function can be ignored
-         * @param msg Message to add data to
+         * The message is already serialized when this is called, so a frame sent to multiple next hops only needs these bytes changed per next hop.
+         * @param connection_data Connection specific data of the serialized message, message::connection_data_size bytes
+         * @param type Type of the message
          * @param next_hop The calculated next hop, in case this is needed
          */
-        virtual void add_connection_data(message &msg, node_id &next_hop) {};
+        virtual void add_connection_data(uint8_t[], const message_type &, node_id &) {};
 
         /**
-         * \brief Implementation of message sending. send_implementation should transmit the given bytes to the node with id "id"
+         * \brief Implementation of message sending. start_transmit should start transmitting the given bytes to the node with id "id"
          *
+         * This method shouldn't wait for the transmission to finish, poll_transmit is called until it has.
+         * Up to transmit_window transmissions can be in progress at a time, these are always for the same id.
+         * When a transmission is started while others are in progress, it should be sent after them.
          * Note that when id is 0, the message should be assumed to be a broadcast message, and treated as such.
-         * send_implementation does not need to check for a connection state to a specific node, since this has already been done by send/send_all
+         * start_transmit does not need to check for a connection state to a specific node, since this has already been done by send/send_all
          * @param id Node id to send the message to
-         * @param data Pointer to the data to send
+         * @param data Pointer to the data to send, this stays valid until the transmission has finished
          * @param size Size of the data to send
-         * @return Wether the transmission was successful
+         * @return False if the transmission could not be started
+         */
+        virtual bool start_transmit(node_id &id, uint8_t *data, size_t size) = 0;
+
+        /**
+         * \brief Check the status of the oldest transmission started by start_transmit
+         *
+         * This method shouldn't block. Once it returns TRANSMIT_SUCCESS or TRANSMIT_FAILED, the oldest transmission is finished.
+         * When a transmission fails, all transmissions started after it should be cancelled, they are started again later.
+         * @return The status of the oldest transmission in progress
+         */
+        virtual transmit_status poll_transmit() = 0;
+
+        /**
+         * \brief Get the amount of transmissions to the same node that can be in progress at the same time
+         *
+         * Connection methods that have a transmit FIFO can return its depth, so consecutive frames don't each wait for the previous one to finish.
+         * Values higher than max_transmit_window are ignored.
+         * @return The window size, 1 by default
+         */
+        virtual size_t transmit_window() { return 1; }
+
+        /**
+         * \brief Called by poll when no transmissions are in flight, and none could be started
+         *
+         * Adapters that keep their connection configured for the last next hop between transmissions can restore it here.
+         * Note that this is called on every idle poll.
+         */
+        virtual void transmit_idle() {}
+
+        /**
+         * \brief Get the amount of attempts the connection method needed for the transmission that poll_transmit just reported
+         *
+         * Connection methods with automatic retransmission should include those retransmits. This is used to estimate link quality.
+         * @return The amount of attempts, 1 by default
+         */
+        virtual uint8_t transmit_attempts() { return 1; }
+
+        /**
+         * \brief Check if the connection method has a frame available
+         *
+         * @return True if there is a frame available, false otherwise
+         */
+        virtual bool has_frame() = 0;
+
+        /**
+         * \brief Gets the first available frame, this should be done in FIFO order.
+         *
+         * Note that since some time elapses between frame requests, buffering frames might be necessary, to prevent buffer overrun on a connection adapter's registers.
+         * The returned view points into the adapter's receive buffer. It should stay valid until the next call to next_frame, also when has_frame or start_transmit is called in between.
+         * @return View of the frame, or an invalid view if none is available
+         */
+        virtual message_view next_frame() = 0;
+
+    private:
+        /**
+         * \brief Check if a message of a given type may be sent to next_hop
+         *
+         * Messages can only be sent over ACCEPTED connections, except for broadcasts and the discovery messages that set up a connection.
+         * @param type Type of the message
+         * @param receiver Receiver of the message
+         * @param next_hop Next hop the message would be sent through
+         * @return True if the message can be sent
+         */
+        bool can_send(const message_type &type, const node_id &receiver, node_id next_hop);
+
+        /**
+         * \brief Add serialized message bytes to the transmit queue
+         *
+         * The bytes are copied once, and sent to every next hop in order.
+         * @param type Type of the message
+         * @param priority Traffic class to queue the bytes in
+         * @param next_hops Nodes to send the bytes to
+         * @param hop_count Amount of next hops, at most multicast_group_size
+         * @param data Serialized message
+         * @param size Size of the serialized message
+         * @param patch_connection_data True if add_connection_data should be called for each next hop
+         * @param alternatives True if the bytes only need to reach one of the next hops, trying them in order
+         * @return True if the bytes were queued, false if the queue of the traffic class is full
+         */
+        bool enqueue(const message_type &type, traffic_class priority, const node_id *next_hops, size_t hop_count,
+                     const uint8_t *data, size_t size, bool patch_connection_data = false,
+                     bool alternatives = false);
+
+        /**
+         * \brief Check which of a next hop and its backup hop can be used for a unicast message
+         *
+         * When next_hop can't be used, the backup hop takes its place. A backup hop that can't be used, or equals next_hop, is set to 0.
+         * @param type Type of the message
+         * @param receiver Receiver of the message
+         * @param next_hop Next hop of the message, updated
+         * @param backup_hop Backup hop of the message, updated
+         * @return False if neither can be used
+         */
+        bool select_hops(const message_type &type, const node_id &receiver, node_id &next_hop, node_id &backup_hop);
+
+        /**
+         * \brief Check if a queue entry still has to be sent to a next hop
+         *
+         * Only the current next hop of an entry with alternatives counts, since the backups might never be used.
+         * @param entry Entry to check
+         * @param next_hop Next hop to look for
+         * @return True if next_hop is one of the entry's remaining next hops
+         */
+        static bool has_next_hop(const transmit_entry &entry, const node_id &next_hop);
+
+        /**
+         * \brief Remove a next hop from a queue entry, freeing the entry when no next hops are left
+         * @param entry Entry to remove the next hop from
+         * @param index Index of the next hop in the entry
+         */
+        static void remove_next_hop(transmit_entry &entry, size_t index);
+
+        /**
+         * \brief Find the queued message that should be transmitted next
+         *
+         * Messages of the highest traffic class are picked first, strictly: a lower class is only picked when no higher class can be sent right now.
+         * Within a class, messages for the same next hop are sent in FIFO order, also when some of them are send_all frames for multiple next hops.
+         * Of all next hops that aren't waiting for a retry, the oldest message is picked.
+         * While transmissions are in flight, only messages for the same next hop are considered.
+         * @return The entry, or nullptr if no message can be sent right now
          */
-        virtual bool send_implementation(node_id &id, uint8_t *data, size_t size) = 0;
+        transmit_entry *next_transmission();
+
+        /**
+         * \brief Handle a failed transmission attempt
+         *
+         * Before the next attempt, the entry waits one poll per attempt it made.
+         * When the entry has been attempted max_transmit_attempts times, it fails for its current next hop, together with all other messages for that next hop.
+         * @param entry Entry that failed to send
+         */
+        void transmit_failed(transmit_entry &entry);
+
+        /**
+         * \brief Add the result of a single transmission to the link statistics of a neighbour
+         * @param next_hop Neighbour the frame was sent to
+         * @param attempts Amount of attempts the connection method used
+         * @param success True if the frame was delivered
+         */
+        void record_link_sample(const node_id &next_hop, uint8_t attempts, bool success);
+
+        /**
+         * \brief Find the entry of a node
+         * @param id Id of the node
+         * @return Index of the entry in nodes, or max_nodes if the node isn't remembered
+         */
+        size_t find_node(const node_id &id) const;
+
+        /**
+         * \brief Get the entry of a node, and mark it as used
+         *
+         * When the node isn't remembered yet, it gets an unused entry, or the entry of the least recently used node.
+         * @param id Id of the node
+         * @return The entry
+         */
+        node_state &use_node(const node_id &id);
+
+        /**
+         * \brief Remove the current next hop from an entry, and inform the transmit_listener
+         *
+         * The entry is removed from the queue once it has no next hops left.
+         * @param entry Entry to finish
+         * @param success Whether the entry was sent successfully
+         */
+        void finish_transmission(transmit_entry &entry, bool success);
+
+        /**
+         * \brief Queue serialized message bytes, or add them to the coalesce buffer for next_hop
+         *
+         * Bytes are only coalesced if coalescing is enabled, they are small enough, and next_hop is an accepted neighbour.
+         * Messages are only coalesced with messages of the same traffic class, so control messages are never held back by a bundle of data.
+         * When the buffer for next_hop has no room left, it is flushed first.
+         * @param type Type of the message
+         * @param next_hop Node to send the bytes to
+         * @param data Serialized message
+         * @param size Size of the serialized message
+         * @return True if the bytes were queued or buffered, false if the transmit queue is full
+         */
+        bool send_or_coalesce(const message_type &type, node_id &next_hop, uint8_t *data, size_t size);
+
+        /**
+         * \brief Queue all messages in a coalesce buffer, and empty it
+         *
+         * A bundle containing a single message is sent as that message.
+         * @param buffer Buffer to flush
+         * @return True if the bundle was queued, false if the transmit queue is full
+         */
+        bool flush_buffer(coalesce_buffer &buffer);
 
     public:
         /**
@@ -90,63 +433,190 @@ namespace mesh {
         /**
          * \brief Remove all messages from history that were sent by a specific node.
          *
-         * This should be used when a node disconnects, since it might have powered down, and it's message id's will start over
+         * This should be used when a node disconnects, since it might have powered down, and it's message id's will start over.
+         * mesh_network also uses this when a connection is (re)accepted, so a neighbour that restarted is recognized as soon as it reconnects.
          * @param id ID of the node to forget message history for
          */
         void forget_message_history_for(const node_id &id);
 
+        /**
+         * \brief Set the amount of message id's per sender that are remembered
+         *
+         * Messages that are older than the window (compared to the newest message of the same sender) are assumed to come from a restarted sender, and are accepted.
+         * @param size Window size, in range 1-32
+         */
+        void set_duplicate_window(uint8_t size);
+
         /**
          * \brief Check if a message was already received before
          *
          * Uses the sender id, combined with the message id.
-         * Message id's overflowing should be no problem, since there are only 20 buffered messages
+         * Every sender has its own sliding window of message id's, so checking a message takes constant time once its sender is found (at most max_nodes comparisons).
+         * Message id's overflowing is handled by comparing id's modulo 256.
+         *
+         * A sender whose message id's are far behind its newest one is assumed to have restarted. This can't be told apart from a late duplicate
+         * when the restarted sender's id's are less than the window behind the old ones: then up to duplicate_window of its first messages are dropped.
+         * For neighbours this is avoided by forgetting their history when their connection is (re)accepted. For other senders, it ends as soon as their id's pass the old ones.
+         * When messages from more than max_nodes senders are received, the least recently seen sender is forgotten, and a duplicate from it would be accepted.
          * @param msg Message to check
          * @return True if the message hasn't been received before, false otherwise
          */
-        bool is_new_message(const message &msg);
+        bool is_new_message(const message_view &msg);
 
         /**
-         * \brief Send a single message to a receiver through next_hop, using send_implementation.
+         * \brief Get the measured cost of the link to a neighbour
          *
+         * The cost is an ETX-like estimate: the expected amount of transmissions needed to deliver a frame, times link_cost_unit.
+         * It is smoothed over the last few transmissions, and combines the retransmits needed for delivered frames with the ratio of frames that failed completely.
+         * Neighbours without any transmissions yet are assumed to be perfect.
+         * @param neighbour Neighbour to get the cost for
+         * @return The cost, in range link_cost_unit-255
+         */
+        uint8_t link_cost(const node_id &neighbour) const;
+
+        /**
+         * \brief Reset the link statistics of a neighbour
+         *
+         * This should be used when a connection is closed, since a new connection to the same node might be completely different.
+         * @param neighbour Neighbour to forget the link statistics for
+         */
+        void forget_link_quality(const node_id &neighbour);
+
+        /**
+         * \brief Queue a single message for sending to a receiver through next_hop.
+         *
+         * This method doesn't wait for the transmission, it returns as soon as the message is queued.
+         * The transmission itself is done by poll, and its result is reported to the transmit_listener.
+         * The message is queued in the queue of its traffic class (see get_traffic_class), so a full data queue never holds back discovery or routing messages.
          * If next_hop is 0, the message is sent directly to the message's receiver.
-         * If both next_hop and the message's receiver are 0, the message is assumed to be a broadcast, note that send_implementation needs to handle this properly
+         * If both next_hop and the message's receiver are 0, the message is assumed to be a broadcast, note that start_transmit needs to handle this properly
+         * With a backup hop, the message is sent to the backup hop right away when all attempts for next_hop failed.
+         * The failure of next_hop is still reported to the transmit_listener. Messages with a backup hop are never coalesced.
          * @param message Message to send
          * @param next_hop First hop to pass through on the way to the message's receiver
-         * @return True if sending was successful, false otherwise
+         * @param backup_hop Neighbour to use when next_hop fails, 0 for none
+         * @return True if the message was queued, false if it can't be sent to next_hop (or the backup hop), or the queue of its traffic class is full
          */
 
 
-        bool send(message &message, node_id next_hop = 0);
+        bool send(message &message, node_id next_hop = 0, node_id backup_hop = 0);
+
+        /**
+         * \brief Send an already serialized message through next_hop, without copying it.
+         *
+         * The message is transmitted exactly as it was received, this is used for relaying messages from other nodes.
+         * No message id is added, and connection data is only added when there is a backup hop.
+         * Like send(message&, node_id, node_id), this only queues the message.
+         * @param msg View of the message to send
+         * @param next_hop First hop to pass through on the way to the message's receiver, or 0 to send directly to the receiver
+         * @param backup_hop Neighbour to use when next_hop fails, 0 for none
+         * @return True if the message was queued, false if it can't be sent to next_hop (or the backup hop), or the queue is full
+         */
+        bool send(const message_view &msg, node_id next_hop = 0, node_id backup_hop = 0);
 
         /**
-         * \brief Sends a single message to all directly connected nodes. Addresses the message to each receiver.
+         * \brief Sends a single message to all directly connected nodes, except the message's sender.
          *
-         * Returns false if any of the transmissions had failed. For every failed transmission, the receiver's address is placed in "failed_addresses".
+         * The message is serialized once, and queued once for up to multicast_group_size neighbours. Only the connection data is changed per neighbour, right before it is transmitted.
+         * Messages sent with send_all are never coalesced.
+         * Returns false if the message couldn't be queued for any of the neighbours. For every one of these, the neighbour's address is placed in "failed_addresses".
+         * Transmission failures are reported to the transmit_listener, once per neighbour.
          * Make sure failed_addresses has at least as much bytes of space as the current neighbour count
          * @param msg Message to send
          * @param failed_addresses Pointer to a memory location to store failed connections in
-         * @return True if all transmissions were successful, false if any of them failed
+         * @return True if the message was queued for all neighbours, false otherwise
          */
         bool send_all(message &msg, node_id *failed_addresses = nullptr);
 
+        /**
+         * \brief Enable coalescing of small messages
+         *
+         * When enabled, unicast messages of at most threshold bytes are not sent immediately.
+         * Instead, messages for the same next hop are packed together in a single TRANSPORT::BUNDLE frame.
+         * A bundle is queued when no more messages fit in it, or when it has been waiting for deadline ticks.
+         * Transmission failures of bundles are reported to the transmit_listener, with type TRANSPORT::BUNDLE.
+         * The receiving adapter unpacks bundles in next_message.
+         * @param threshold Maximum size of a message to coalesce, 0 to disable coalescing
+         * @param deadline Maximum amount of flush_coalesced calls a message can wait
+         */
+        void enable_coalescing(size_t threshold, uint16_t deadline);
 
-        // Connection-type specific methods
+        /**
+         * \brief Age the coalesce buffers by one tick, and queue the ones that reached their deadline
+         *
+         * When the transmit queue is full, buffers are kept until the next call.
+         * @param force Queue all coalesce buffers, regardless of their deadline
+         */
+        void flush_coalesced(bool force = false);
 
         /**
-         * \brief Check if the connection method has a message available
+         * \brief Get the traffic class messages of a type are queued in
+         *
+         * Unless set_traffic_class was used for the type, the class is derived from it:
+         * DISCOVERY messages (0x0_) are CLASS_DISCOVERY, routing messages (0x1_) are CLASS_ROUTING, everything else is CLASS_DATA.
+         * @param type Type of the message
+         * @return The traffic class
+         */
+        traffic_class get_traffic_class(const message_type &type) const;
+
+        /**
+         * \brief Set the traffic class of a message type, instead of deriving it from the type
+         *
+         * This can be used to send urgent application messages (like alarms) before routing traffic, or to send bulk routing traffic after data.
+         * All nodes don't need to use the same classes, the class only affects the order in which this node transmits.
+         * At most max_class_overrides types can have their class changed.
+         * @param type Type of the message
+         * @param priority Traffic class to use for the type
+         * @return False if max_class_overrides other types already have their class changed
+         */
+        bool set_traffic_class(const message_type &type, traffic_class priority);
+
+        /**
+         * \brief Set the listener that is informed about the result of queued transmissions
+         * @param transmitListener The listener
+         */
+        void set_transmit_listener(transmit_listener &transmitListener);
+
+        /**
+         * \brief Advance the transmit queue
+         *
+         * Checks the status of the transmissions in flight, and starts new ones until the transmit window is filled.
+         * This method never waits for the connection method, so it should be called often.
+         * mesh_network calls this on every check_new_messages and update.
+         */
+        void poll();
+
+        /**
+         * \brief Check if any messages are waiting to be transmitted
+         * @return True if the transmit queue is not empty
+         */
+        bool is_transmitting();
+
+        /**
+         * \brief Get the amount of messages waiting in the transmit queue of a traffic class
+         * @param priority Traffic class to count
+         * @return The amount of queued messages, at most class_queue_size
+         */
+        size_t get_queued_count(traffic_class priority);
+
+        /**
+         * \brief Check if a message is available
          *
          * @return True if there is a message available, false otherwise
          */
-        virtual bool has_message() = 0;
+        bool has_message();
 
         /**
-         * \brief Gets the first available message, this should be done in FIFO order.
+         * \brief Gets the first available message, in FIFO order.
          *
-         * Mesh_network checks if there are messages available before retrieving them, so return value when there is no message available does not matter
-         * Note that since some time elapses between message requests, buffering messages might be necessary, to prevent buffer overrun on a connection adapter's registers.
-         * @return
+         * Frames are read using next_frame. When a frame is a TRANSPORT::BUNDLE, the messages in it are returned one by one.
+         * The returned view points into the adapter's receive buffer. It stays valid until the next call to next_message, also when has_message or send is called in between.
+         * @return View of the message, or an invalid view if none is available
          */
-        virtual message next_message() = 0;
+        message_view next_message();
+
+
+        // Connection-type specific methods
 
         /**
          * \brief Retrieve current connection state of a direct connection to the node with id "id".
@@ -43,6 +43,32 @@ namespace mesh {
                 ACCEPTED
     };
 
+    /**
+     * \brief Status of a transmission started by a connectivity adapter
+     */
+    enum transmit_status {
+        /// The transmission is still in progress
+                TRANSMIT_PENDING,
+        /// The transmission was successful (and acknowledged, if the connection method supports this)
+                TRANSMIT_SUCCESS,
+        /// The transmission failed
+                TRANSMIT_FAILED
+    };
+
+    /**
+     * \brief Priority class of an outgoing message, see connectivity_adapter::get_traffic_class
+     *
+     * Every class has its own transmit queue. Queued messages of a lower class are only transmitted when no higher class has messages that can be sent.
+     */
+    enum traffic_class {
+        /// Discovery and keepalive messages (DISCOVERY), highest priority
+                CLASS_DISCOVERY,
+        /// Routing messages
+                CLASS_ROUTING,
+        /// Everything else, like DOMOTICA data and fragments, lowest priority
+                CLASS_DATA
+    };
+
     /**
      * \brief Message types for basic discovery messages
      */
@@ -68,6 +94,34 @@ namespace mesh {
         static constexpr const uint8_t UPDATE_REQUEST = 0x10;
         /// Send neighbour information
         static constexpr const uint8_t UPDATE = 0x11;
+        /// Send the neighbours that changed since the previous update of the sender
+        static constexpr const uint8_t UPDATE_DELTA = 0x12;
+        /// Ask a node for its complete neighbour information, sent as unicast when a delta can't be applied
+        static constexpr const uint8_t RESYNC_REQUEST = 0x13;
+        /// Tell all neighbours which of them were selected as multipoint relay, this is not passed on
+        static constexpr const uint8_t MPR_SELECT = 0x14;
+    };
+
+    /**
+     * \brief Message types for distance vector routing
+     */
+    struct DISTANCE_VECTOR_ROUTING {
+        /// Request the routing tables of all neighbours, this also contains the routing table of the sender
+        static constexpr const uint8_t UPDATE_REQUEST = 0x18;
+        /// Send routing table entries to neighbours
+        static constexpr const uint8_t UPDATE = 0x19;
+    };
+
+    /**
+     * \brief Message types for on demand (AODV) routing
+     */
+    struct AODV_ROUTING {
+        /// Look for a route to a destination, this is passed on by every node until it reaches the destination or a node with a route
+        static constexpr const uint8_t ROUTE_REQUEST = 0x1A;
+        /// Answer to a ROUTE_REQUEST, sent back hop by hop to the node that requested the route
+        static constexpr const uint8_t ROUTE_REPLY = 0x1B;
+        /// Tell neighbours that routes through the sender broke
+        static constexpr const uint8_t ROUTE_ERROR = 0x1C;
     };
 
     /**
@@ -78,6 +132,16 @@ namespace mesh {
         static constexpr const uint8_t DATA = 0x20;
     };
 
+    /**
+     * \brief Message types for the transport layer
+     */
+    struct TRANSPORT {
+        /// A single fragment of a payload that was too large for one message, see fragment_reassembly
+        static constexpr const uint8_t FRAGMENT = 0x40;
+        /// Several small messages for the same next hop, packed in one frame by connectivity_adapter. Never leaves the connectivity adapter
+        static constexpr const uint8_t BUNDLE = 0x41;
+    };
+
     /**
      * @}
      */
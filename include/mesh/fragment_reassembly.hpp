@@ -0,0 +1,195 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_MESH_FRAGMENT_REASSEMBLY_HPP
+#define IPASS_MESH_FRAGMENT_REASSEMBLY_HPP
+
+#include <mesh/message.hpp>
+#include <mesh/definitions.hpp>
+
+namespace mesh {
+    /**
+     * \addtogroup mesh_networking
+     * @{
+     */
+
+    /**
+     * \brief Reassembles payloads that were split into TRANSPORT::FRAGMENT messages
+     *
+     * Each fragment is a normal message, so it is relayed hop by hop like any other message.
+     * Fragment payloads are formatted as follows:
+     * 1st byte: type of the original payload
+     * 2nd byte: transfer id, chosen by the sender
+     * 3rd byte: index of this fragment
+     * 4th byte: total fragment count
+     * Remaining bytes: the fragment data, which is fragment_data_size bytes for all but the last fragment
+     *
+     * Memory use is bounded: a fixed amount of buffers is used, a sender can only use per_sender_limit buffers at once,
+     * and buffers that don't receive anything for timeout ticks are freed.
+     * This class doesn't own the buffers, use fragment_pool to create a reassembler with storage.
+     */
+    class fragment_reassembly {
+    public:
+        /// Size of the fragment header in each fragment's payload
+        static constexpr const size_t header_size = 4;
+        /// Amount of payload bytes carried by a single fragment
+        static constexpr const size_t fragment_data_size = message::payload_size - header_size;
+        /// Maximum amount of fragments a payload can be split into
+        static constexpr const size_t max_fragments = 255;
+
+        /**
+         * \brief Reassembly state of a single payload
+         */
+        struct reassembly_buffer {
+            /// True if this buffer is used by a transfer
+            bool in_use = false;
+            /// True if all fragments were received
+            bool complete = false;
+            /// Original sender of the payload
+            node_id sender = 0;
+            /// Transfer id of the payload, unique per sender
+            uint8_t transfer_id = 0;
+            /// Type of the payload
+            message_type type = 0;
+            /// Total amount of fragments in this transfer
+            uint8_t fragment_count = 0;
+            /// Amount of unique fragments received so far
+            uint8_t received_count = 0;
+            /// Bitmap of received fragment indexes
+            std::array<uint8_t, (max_fragments + 7) / 8> received = {0};
+            /// Size of the reassembled payload, known after the last fragment was received
+            size_t size = 0;
+            /// Ticks since the last fragment was received
+            uint16_t age = 0;
+            /// Storage for the payload
+            uint8_t *data = nullptr;
+        };
+
+    private:
+        size_t buffer_count;
+        size_t buffer_size;
+        uint8_t per_sender_limit;
+        uint16_t timeout;
+
+        /**
+         * \brief Find the buffer used for a transfer
+         * @param sender Sender of the transfer
+         * @param transfer_id Id of the transfer
+         * @return The buffer, or nullptr if there is none
+         */
+        reassembly_buffer *find(const node_id &sender, const uint8_t &transfer_id);
+
+        /**
+         * \brief Claim a free buffer for a new transfer
+         *
+         * Fails when the sender already uses per_sender_limit buffers, or when no buffers are free.
+         * @param sender Sender of the new transfer
+         * @return The buffer, or nullptr if none could be claimed
+         */
+        reassembly_buffer *claim(const node_id &sender);
+
+    protected:
+        /// Array of buffer_count reassembly buffers, each with buffer_size bytes of data storage. Set by the class providing the storage
+        reassembly_buffer *buffers = nullptr;
+
+        /**
+         * \brief Create a reassembler, storage should be set by the subclass
+         *
+         * @param buffer_count Amount of buffers
+         * @param buffer_size Maximum payload size per buffer
+         * @param per_sender_limit Maximum amount of buffers a single sender can use at once
+         * @param timeout Amount of ticks after which an unfinished or unread payload is dropped
+         */
+        fragment_reassembly(size_t buffer_count, size_t buffer_size, uint8_t per_sender_limit, uint16_t timeout);
+
+    public:
+        /**
+         * \brief Calculate the amount of fragments needed to send a payload
+         * @param size Size of the payload
+         * @return The fragment count
+         */
+        static size_t fragment_count(size_t size) {
+            return size == 0 ? 1 : (size + fragment_data_size - 1) / fragment_data_size;
+        }
+
+        /**
+         * \brief Write a single fragment of a payload to a message
+         *
+         * Sets the message type, payload and payload size. Sender and receiver are left untouched.
+         * @param msg Message to write the fragment to
+         * @param type Type of the complete payload
+         * @param transfer_id Transfer id of the payload
+         * @param index Index of the fragment to write
+         * @param data Complete payload
+         * @param size Size of the complete payload
+         */
+        static void fill_fragment(message &msg, const message_type &type, const uint8_t &transfer_id,
+                                  const uint8_t &index, const uint8_t *data, size_t size);
+
+        /**
+         * \brief Handle a received TRANSPORT::FRAGMENT message
+         *
+         * Duplicate fragments are ignored.
+         * @param msg The fragment
+         * @return False if the fragment was invalid, or there was no room to store it
+         */
+        bool add_fragment(const message &msg);
+
+        /**
+         * \brief Age all buffers by one tick, freeing buffers that timed out
+         */
+        void tick();
+
+        /**
+         * \brief Get a completely reassembled payload
+         *
+         * The buffer stays in use until it is released with release(), or times out.
+         * @return A completed buffer, or nullptr if there are none
+         */
+        const reassembly_buffer *next_completed();
+
+        /**
+         * \brief Release a buffer returned by next_completed, so it can be used for new transfers
+         * @param buffer Buffer to release
+         */
+        void release(const reassembly_buffer *buffer);
+    };
+
+    /**
+     * \brief Fragment reassembler with its own fixed storage
+     *
+     * @tparam count Amount of payloads that can be reassembled at the same time
+     * @tparam size Maximum size of a reassembled payload
+     */
+    template<size_t count, size_t size>
+    class fragment_pool : public fragment_reassembly {
+        std::array<reassembly_buffer, count> pool_buffers;
+        std::array<std::array<uint8_t, size>, count> pool_data;
+
+    public:
+        /**
+         * \brief Create a fragment pool
+         * @param per_sender_limit Maximum amount of buffers a single sender can use at once
+         * @param timeout Amount of ticks (mesh_network::update calls) after which an unfinished or unread payload is dropped
+         */
+        explicit fragment_pool(uint8_t per_sender_limit = 1, uint16_t timeout = 500) :
+                fragment_reassembly(count, size, per_sender_limit, timeout) {
+            buffers = pool_buffers.data();
+            for (size_t i = 0; i < count; i++) {
+                pool_buffers[i].data = pool_data[i].data();
+            }
+        }
+    };
+
+    /**
+     * @}
+     */
+}
+
+#endif //IPASS_MESH_FRAGMENT_REASSEMBLY_HPP
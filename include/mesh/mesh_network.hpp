@@ -13,6 +13,8 @@
 
 #include <mesh/connectivity_adapter.hpp>
 #include <mesh/router.hpp>
+#include <mesh/fragment_reassembly.hpp>
+#include <mesh/store_and_forward.hpp>
 #include <cout_debug.hpp>
 
 
@@ -45,10 +47,17 @@ namespace mesh {
      *
      * handles discovery messages, keepalives and routing through the given router.
      * Because of the abstraction of connectivity_adapter, this class can work with any connection method.
+     * Messages are sent without waiting for them to be transmitted. When a transmission fails, the connection to that next hop is closed in on_transmit_complete.
+     * Messages without a route can be held in a store_and_forward buffer, until the router reports a new route.
      */
-    class mesh_network {
+    class mesh_network : public transmit_listener, public route_listener {
         connectivity_adapter &connection;
         router &network_router;
+        fragment_reassembly *reassembly = nullptr;
+        store_and_forward *held_messages = nullptr;
+        bool drain_pending = false;
+        uint16_t hop_limit_drops = 0;
+        uint8_t current_transfer_id = 0;
 
         std::array<node_id, 10> blacklist = {0};
         size_t blacklist_size = 0;
@@ -76,8 +85,78 @@ namespace mesh {
             return false;
         }
 
+        /**
+         * \brief Choose a next hop for a message, spreading flows over all equally short paths
+         *
+         * The choice is a hash of the sender, the receiver and this node, so all messages of a flow take the same path and stay in order.
+         * This node's id is part of the hash, so the nodes on a path don't all make the same choice.
+         * The backup hop is the next equally short path, or the router's backup hop if there is only one.
+         * @param sender Original sender of the message
+         * @param receiver Final receiver of the message
+         * @param backup_hop Set to the hop to use when the next hop fails, or 0 if there is none
+         * @return The next hop, or 0 if the router has no route
+         */
+        node_id select_next_hop(const node_id &sender, const node_id &receiver, node_id &backup_hop) {
+            node_id next_hops[max_paths];
+            size_t count = network_router.get_next_hops(receiver, next_hops, max_paths);
+            if (count <= 1) {
+                backup_hop = count == 0 ? 0 : network_router.get_backup_hop(receiver);
+                return count == 0 ? 0 : next_hops[0];
+            }
+            uint8_t hash = uint8_t(sender * 31 + receiver * 7 + connection.id);
+            hash ^= hash >> 4;
+            backup_hop = next_hops[(hash + 1) % count];
+            return next_hops[hash % count];
+        }
+
+        /**
+         * \brief Hold on to a message that couldn't be sent, until a route is found or the transmit queue has room
+         *
+         * The held messages are tried again on the next update, since a full queue doesn't cause a route change.
+         * @param msg Message to hold, with its sender set
+         * @return False if there is no store and forward buffer, or it has no room for the message
+         */
+        bool hold(const message &msg) {
+            if (held_messages == nullptr || !held_messages->store(msg)) {
+                return false;
+            }
+            drain_pending = true;
+            return true;
+        }
+
+        /**
+         * \brief Send the held messages that have a route now, oldest first
+         *
+         * Messages without a route stay in the buffer. Messages that don't fit in the transmit queue stay as well, and are tried again on the next update.
+         * A full queue for one next hop doesn't stop the messages for other next hops.
+         */
+        void drain_held_messages() {
+            drain_pending = false;
+            for (size_t i = 0; i < held_messages->get_count();) {
+                message msg = held_messages->get(i);
+                node_id next_hop = 0;
+                node_id backup_hop = 0;
+                if (connection.connection_state(msg.receiver) != ACCEPTED) {
+                    next_hop = select_next_hop(msg.sender, msg.receiver, backup_hop);
+                    if (next_hop == 0) {
+                        i++;
+                        continue;
+                    }
+                }
+                if (!connection.send(msg, next_hop, backup_hop)) {
+                    drain_pending = true;
+                    i++;
+                    continue;
+                }
+                held_messages->remove(i);
+            }
+        }
+
 
     public:
+        /// Maximum amount of equally short paths that traffic to a single receiver is spread over
+        static constexpr const size_t max_paths = 4;
+
 
         /**
          * \brief Construct a mesh_network
@@ -89,7 +168,10 @@ namespace mesh {
         mesh_network(connectivity_adapter &connection, router &networkrouter) :
                 connection(
                         connection),
-                network_router(networkrouter){}
+                network_router(networkrouter) {
+            connection.set_transmit_listener(*this);
+            network_router.set_route_listener(*this);
+        }
 
         /**
          * \brief Add the given nodes to the direct connection blacklist
@@ -107,6 +189,28 @@ namespace mesh {
             }
         }
 
+        /**
+         * \brief Enable reassembly of fragmented payloads
+         *
+         * Without a reassembler, received TRANSPORT::FRAGMENT messages are left uncaught.
+         * Reassembled payloads can be read from the reassembler, using next_completed().
+         * @param fragments Reassembler to store received fragments in
+         */
+        void set_fragment_reassembly(fragment_reassembly &fragments) {
+            reassembly = &fragments;
+        }
+
+        /**
+         * \brief Enable buffering of messages for receivers that can't be reached yet
+         *
+         * Without a buffer, messages without a route (and relayed messages that can't be queued) are dropped.
+         * With a buffer, they are held until the router reports a new route, for example while the routes converge after a node (re)connects.
+         * @param buffer Store and forward buffer to hold messages in
+         */
+        void set_store_and_forward(store_and_forward &buffer) {
+            held_messages = &buffer;
+        }
+
         /**
          * \brief Broadcast a discovery message to the network
          *
@@ -123,30 +227,60 @@ namespace mesh {
          *
          * This method automatically handles any discovery/routing messages.
          * Anything that remains will be put in the uncaught array, so the caller can handle it.
+         * Messages are read as a view on the connectivity adapter's buffer. Messages for this node are copied once, straight into the uncaught array.
+         * Relayed messages are not copied at all. Their hop limit is decremented in place, and messages that run out of hops are dropped (see get_hop_limit_drop_count).
+         * Copies of flooded routing messages that were already received are passed to router::on_duplicate_routing_message.
+         * When the uncaught array is full, remaining messages are left in the connectivity adapter until the next call.
          *
          * @param uncaught Array reference to put any uncaught messages in
          * @return The count of uncaught messages
          */
         uint8_t check_new_messages(std::array<message, 10> &uncaught) {
             uint8_t index = 0;
-            while (connection.has_message()) {
-                message msg = connection.next_message();
-                if (!connection.is_new_message(msg)) { //message already handled
+            connection.poll();
+            while (index < uncaught.size() && connection.has_message()) {
+                message_view received = connection.next_message();
+                if (!received.is_valid()) {
                     continue;
                 }
-                if (msg.receiver == connection.id ||
-                    msg.receiver == 0) { //Message is for us, or broadcast, take it
+                if (!connection.is_new_message(received)) { //message already handled
+                    if (received.receiver() == 0 && (received.type() & 0x10) > 0) { //A flooded routing message might still have to be passed on
+                        message duplicate;
+                        received.copy_to(duplicate);
+                        network_router.on_duplicate_routing_message(duplicate);
+                    }
+                    continue;
+                }
+                if (received.receiver() == connection.id ||
+                    received.receiver() == 0) { //Message is for us, or broadcast, take it
+                    message &msg = uncaught[index];
+                    received.copy_to(msg);
                     if (!handleMessage(msg)) {
-                        uncaught[index++] = msg;
+                        index++;
+                    }
+                } else { //Not for us, relay message (through routing)
+                    if (received.hop_limit() <= 1) { //Out of hops, probably caught in a routing loop
+                        hop_limit_drops++;
+                        continue;
                     }
-                } else { //Not for us, todo relay message (through routing)
+                    received.set_hop_limit(uint8_t(received.hop_limit() - 1));
                     uint8_t next_hop = 0;
-                    if (connection.connection_state(msg.receiver) != ACCEPTED) {
-                        next_hop = network_router.get_next_hop(msg.receiver);
-                    } else {
+                    uint8_t backup_hop = 0;
+                    if (connection.connection_state(received.receiver()) != ACCEPTED) {
+                        next_hop = select_next_hop(received.sender(), received.receiver(), backup_hop);
+                        if (next_hop == 0) { //No route yet, the router or the store and forward buffer can hold on to it
+                            message held;
+                            received.copy_to(held);
+                            if (!network_router.on_unroutable(held)) {
+                                hold(held);
+                            }
+                            continue;
+                        }
                     }
-                    if (!connection.send(msg, next_hop)) {
-                        network_router.update_neighbours();
+                    if (!connection.send(received, next_hop, backup_hop) && held_messages != nullptr) {
+                        message held;
+                        received.copy_to(held);
+                        hold(held);
                     }
                 }
 
@@ -158,6 +292,9 @@ namespace mesh {
          * \brief Handles discovery and keepalives
          *
          * Sends a keepalive, and a discovery message every "keepalive_interval" updates
+         * Together with the keepalive, the router's neighbour information is refreshed. When it changed (for example because a link got worse), an update is sent.
+         * Also queues coalesced messages that reached their deadline, advances the transmit queue, and lets the router do its periodic work.
+         * Held messages are aged, and sent when the router reported a new route since the last update.
          * TODO: seperate this
          */
         void update() {
@@ -165,6 +302,19 @@ namespace mesh {
                 update_count = 0;
                 discover();
             }
+            if (reassembly != nullptr) {
+                reassembly->tick();
+            }
+            network_router.update();
+            if (held_messages != nullptr) {
+                held_messages->tick();
+                if (drain_pending) {
+                    drain_held_messages();
+                }
+            }
+
+            connection.flush_coalesced();
+            connection.poll();
             if (update_count == (keepalive_interval)) {
 
                 message keepalive = {
@@ -174,62 +324,105 @@ namespace mesh {
                         0
                 };
                 unicast_all_close_if_fail(keepalive);
+                if (network_router.update_neighbours()) {
+                    network_router.send_update();
+                }
             }
         }
 
         /**
-         * \brief Unicast a message to a node, and close it's connection immediately if the transmit fails
+         * \brief Unicast a message to a node, and close it's connection if the transmit fails
          *
+         * Since every failed transmission closes its connection (see on_transmit_complete), this only queues the message.
          * @param msg Message to send
          * @param next_hop First hop to send it through
          */
         void unicast_close_if_fail(message &msg, const node_id &next_hop = 0) {
-            if (!connection.send(msg, next_hop)) {
-                connection.remove_direct_connection(next_hop != 0 ? next_hop : msg.receiver);
-                network_router.send_update();
-            }
+            connection.send(msg, next_hop);
         }
 
         /**
          * \brief Unicast a message to all connected neighbours. Close every connection that fails to transmit.
          *
          * Is used for keepalives.
+         * Since every failed transmission closes its connection (see on_transmit_complete), this only queues the message.
          * @param msg Message to send
          */
         void unicast_all_close_if_fail(message &msg) {
-            size_t count = connection.get_neighbour_count();
-            node_id failed[count];
+            connection.send_all(msg);
+        }
 
-            for (size_t i = 0; i < count; i++) {
-                failed[i] = 0;
+        /**
+         * \brief Handle the result of a queued transmission
+         *
+         * The connectivity adapter only reports failure after several attempts, so the connection is assumed to be broken.
+         * It is closed, and the router is informed, so the topology change is sent into the network.
+         * The messages that were dropped with it are reported too, those don't cause another update.
+         * @param next_hop Node the message was sent to
+         * @param type Type of the message
+         * @param success True if the message was sent successfully
+         */
+        void on_transmit_complete(const node_id &next_hop, const message_type &, bool success) override {
+            if (success || next_hop == 0 || connection.connection_state(next_hop) == DISCONNECTED) { // Already closed
+                return;
             }
+            connection.remove_direct_connection(next_hop);
+            network_router.send_update();
+        }
 
-            if (!connection.send_all(msg, failed)) {
-                for (size_t i = 0; i < connection.get_neighbour_count(); i++) {
-                    if (failed[i] == 0) {
-                        continue;
-                    }
-                    connection.remove_direct_connection(failed[i]);
-                }
-                network_router.send_update();
-            }
+        /**
+         * \brief Note that the router found a new route, so held messages are sent on the next update
+         */
+        void on_routes_changed() override {
+            drain_pending = true;
         }
 
         /**
          * \brief Transmit a message to a receiver, using the network_router
          *
-         * Note that this function ignores failure
+         * Note that this function doesn't handle failure, it only reports it.
+         * When the router knows several equally short paths, the path is chosen per flow (see select_next_hop).
+         * When the next hop fails, the message is sent to the backup hop right away, while the router is informed of the failure.
+         * When the router has no next hop, the message is passed to router::on_unroutable, so routers that find routes on demand can send it later.
+         * If the router doesn't take it, or the transmit queue is full, it is held in the store and forward buffer (see set_store_and_forward).
          * @param msg message to send, receiver should be set on this message
+         * @return True if the message was passed on to the next hop, or held by the router or the store and forward buffer
          */
-        void sendMessage(message &msg) {
-            uint8_t nextAddress = network_router.get_next_hop(msg.receiver);
+        bool sendMessage(message &msg) {
+            msg.sender = connection.id;
+            uint8_t backupAddress = 0;
+            uint8_t nextAddress = select_next_hop(msg.sender, msg.receiver, backupAddress);
             if (nextAddress == 0) {
-                return;
+                return network_router.on_unroutable(msg) || hold(msg);
             }
-            msg.sender = connection.id;
-            if (!connection.send(msg, nextAddress)) {
-//                router.update_neighbours();
+            return connection.send(msg, nextAddress, backupAddress) || hold(msg);
+        }
+
+        /**
+         * \brief Transmit a payload of any size to a receiver, split into TRANSPORT::FRAGMENT messages
+         *
+         * Every fragment is routed separately, and reassembled by the receiver's fragment_reassembly.
+         * Since every fragment is acknowledged hop by hop, a lost fragment only costs a retransmission of that fragment.
+         * @param type Type of the payload, passed on to the receiver
+         * @param receiver Node to send the payload to
+         * @param data Payload to send
+         * @param size Size of the payload
+         * @return False if the payload is too large, or a fragment could not be passed on to the next hop
+         */
+        bool send_fragmented(const message_type &type, const node_id &receiver, const uint8_t *data, size_t size) {
+            size_t count = fragment_reassembly::fragment_count(size);
+            if (count > fragment_reassembly::max_fragments) {
+                return false;
             }
+            uint8_t transfer_id = current_transfer_id++;
+            for (size_t i = 0; i < count; i++) {
+                message fragment = {TRANSPORT::FRAGMENT, 0, connection.id, receiver};
+                fragment_reassembly::fill_fragment(fragment, type, transfer_id, uint8_t(i), data, size);
+                if (!sendMessage(fragment)) {
+                    return false;
+                }
+            }
+            return true;
         }
 
         /**
@@ -248,6 +441,14 @@ namespace mesh {
                 return false;
             }
 
+            if (msg.type == TRANSPORT::FRAGMENT) {
+                if (reassembly == nullptr) {
+                    return false;
+                }
+                reassembly->add_fragment(msg);
+                return true;
+            }
+
             if (is_blacklisted(msg.sender)) {
                 return true;
             }
@@ -266,11 +467,14 @@ namespace mesh {
                     break;
                 case DISCOVERY::RESPOND: {
                     if (connection.discovery_respond_received(msg)) {
+                        connection.forget_message_history_for(msg.sender); // It might have restarted
 
                         message finishMessage = {DISCOVERY::ACCEPT, 0, connection.id,
                                                  msg.sender, 0};
                         if (connection.send(finishMessage)) {
                             network_router.update_neighbours();
+                            // Both sides announce themselves, the node that restarted might be either of them
+                            network_router.initial_update();
                         }
 
                     } else {
@@ -282,6 +486,7 @@ namespace mesh {
                 }
                 case DISCOVERY::ACCEPT:
                     connection.discovery_accept_received(msg);
+                    connection.forget_message_history_for(msg.sender);
                     network_router.initial_update();
                     break;
                 case DISCOVERY::DENY:
@@ -318,6 +523,16 @@ namespace mesh {
             return network_router;
         }
 
+        /**
+         * \brief Get the amount of messages that were not relayed, because their hop limit ran out
+         *
+         * A rising count means messages are looping, for example while nodes disagree about the topology.
+         * @return The drop count, wraps around
+         */
+        uint16_t get_hop_limit_drop_count() const {
+            return hop_limit_drops;
+        }
+
 
 
     };
@@ -22,16 +22,69 @@ namespace mesh {
     /// \brief Alias uint8_t to make function definitions easier to understand
     typedef uint8_t node_id;
 
+    /**
+     * \brief Message layouts for different connection methods
+     *
+     * A layout determines the payload capacity of a message, the size of the connection specific data, and the type used for the payload size.
+     * The payload size is transmitted using sizeof(size_type) bytes, so large payloads make the header grow.
+     * Every node in a network needs to use the same layout.
+     */
+    namespace message_traits {
+        /**
+         * \brief Layout that fills a single NRF24L01+ frame of 32 bytes
+         */
+        struct nrf24 {
+            /// Maximum payload size in bytes
+            static constexpr const size_t payload_size = 24;
+            /// Size of the connection specific data in bytes
+            static constexpr const size_t connection_data_size = 2;
+            /// Type used to store the payload size
+            typedef uint8_t size_type;
+        };
+
+        /**
+         * \brief Layout for connection methods that carry large datagrams, like UDP on a host
+         */
+        struct datagram {
+            /// Maximum payload size in bytes
+            static constexpr const size_t payload_size = 1024;
+            /// Size of the connection specific data in bytes
+            static constexpr const size_t connection_data_size = 0;
+            /// Type used to store the payload size
+            typedef uint16_t size_type;
+        };
+    }
+
     /**
      * \brief A message to be used in a mesh network
+     *
+     * @tparam traits Message layout, see message_traits
      */
-    struct message {
+    template<typename traits>
+    struct basic_message {
+        /// Type used to store the payload size
+        typedef typename traits::size_type size_type;
+
+        /// Maximum payload size in bytes
+        static constexpr const size_t payload_size = traits::payload_size;
+        /// Size of the connection specific data in bytes
+        static constexpr const size_t connection_data_size = traits::connection_data_size;
+        /// Size of the header (type, message_id, sender, receiver, hop_limit and dataSize) in bytes
+        static constexpr const size_t header_size = 5 + sizeof(size_type);
+        /// Bytesize of a message with a full payload
+        static constexpr const size_t max_size = header_size + payload_size + connection_data_size;
+        /// Hop limit of new messages, the maximum amount of nodes that can relay a message
+        static constexpr const uint8_t default_hop_limit = 16;
+
+        static_assert(payload_size < (size_t(1) << (8 * sizeof(size_type))),
+                      "size_type is too small for the payload size");
+
         /**
          * Get the bytesize of this message eg. The amount of bytes needed to transmit it fully
          * @return The bytesize
          */
         size_t size() {
-            return dataSize + 7;
+            return dataSize + header_size + connection_data_size;
         }
 
         /// Type of the message, see definitions.h
@@ -42,17 +95,19 @@ namespace mesh {
         node_id sender;
         /// Receiver of the message, messages with receiver 0 are assumed to be a broadcast
         node_id receiver;
+        /// Remaining amount of hops, every relay decrements it, and a message that would be relayed with hop limit 0 is dropped
+        uint8_t hop_limit;
         /// Size of the payload of this message
-        uint8_t dataSize;
+        size_type dataSize;
         /// Payload of this message
-        std::array<uint8_t, 25> data = {0};
+        std::array<uint8_t, payload_size> data = {0};
         /// Additional data, used for connectivity method specific interaction
-        std::array<uint8_t, 2> connectionData = {0};
+        std::array<uint8_t, connection_data_size> connectionData = {};
 
         /**
          * Make an empty message
          */
-        message() : type(0), message_id(0), sender(0), receiver(0), dataSize(0) {}
+        basic_message() : type(0), message_id(0), sender(0), receiver(0), hop_limit(default_hop_limit), dataSize(0) {}
 
         /**
          * Create a message
@@ -64,10 +119,13 @@ namespace mesh {
          * @param data Message payload
          * @param connectionData Connection specific data
          */
-        message(message_type messageType, uint8_t messageId, node_id sender, node_id receiver, size_t dataSize = 0,
-                const std::array<uint8_t, 25> &data = {0}, const std::array<uint8_t, 2> &connectionData = {0})
+        basic_message(message_type messageType, uint8_t messageId, node_id sender, node_id receiver,
+                      size_t dataSize = 0,
+                      const std::array<uint8_t, payload_size> &data = {0},
+                      const std::array<uint8_t, connection_data_size> &connectionData = {})
                 : type(
-                messageType), message_id(messageId), sender(sender), receiver(receiver), dataSize(dataSize),
+                messageType), message_id(messageId), sender(sender), receiver(receiver), hop_limit(default_hop_limit),
+                  dataSize(dataSize),
                   data(data),
                   connectionData(
                           connectionData) {}
@@ -76,7 +134,7 @@ namespace mesh {
          * \brief Write the message data to a byte array
          *
          * Make sure the array has at least message.size() bytes of space.
-         * This method always writes the connection specific data, if this is not needed, the last 2 bytes can be cut off later.
+         * This method always writes the connection specific data, if this is not needed, the last bytes can be cut off later.
          * @param out Memory location to write to
          */
         void to_byte_array(uint8_t out[]) {
@@ -84,19 +142,24 @@ namespace mesh {
             out[1] = message_id;
             out[2] = sender;
             out[3] = receiver;
-            out[4] = dataSize;
+            out[4] = hop_limit;
+            for (size_t i = 0; i < sizeof(size_type); i++) {
+                out[5 + i] = uint8_t(dataSize >> (8 * i));
+            }
 
             for (size_t i = 0; i < dataSize; i++) {
-                out[i + 5] = data[i];
+                out[i + header_size] = data[i];
+            }
+            for (size_t i = 0; i < connection_data_size; i++) {
+                out[size() - connection_data_size + i] = connectionData[i];
             }
-            out[size() - 2] = connectionData[0];
-            out[size() - 1] = connectionData[1];
         }
 
         /**
          * \brief Parse a byte array, and save the result in the current message.
          *
          * When the data is not large enough to contain a message, this method does nothing but return false.
+         * Payload that doesn't fit in this message's layout is cut off.
          * @param n Size of the byte array.
          * @param in Memory location of the byte array
          * @return True if the byte array was a valid message, and it was processed, false otherwise.
@@ -106,7 +169,7 @@ namespace mesh {
             connectionData.fill(0);
 
 
-            if (n < 7) {
+            if (n < header_size + connection_data_size) {
                 return false;
             }
 
@@ -114,14 +177,22 @@ namespace mesh {
             message_id = in[1];
             sender = in[2];
             receiver = in[3];
-            dataSize = in[4];
-
+            hop_limit = in[4];
+            dataSize = 0;
+            for (size_t i = 0; i < sizeof(size_type); i++) {
+                dataSize |= size_type(in[5 + i] << (8 * i));
+            }
+            if (dataSize > payload_size) {
+                dataSize = payload_size;
+            }
 
-            for (size_t i = 0; i < (n - 7); i++) {
-                data[i] = in[i + 5];
+            size_t received_size = n - header_size - connection_data_size;
+            for (size_t i = 0; i < received_size && i < payload_size; i++) {
+                data[i] = in[i + header_size];
+            }
+            for (size_t i = 0; i < connection_data_size; i++) {
+                connectionData[i] = in[n - connection_data_size + i];
             }
-            connectionData[0] = in[n - 2];
-            connectionData[1] = in[n - 1];
             return true;
         }
 
@@ -135,12 +206,16 @@ namespace mesh {
          * @param message
          * @return
          */
-        friend hwlib::ostream &operator<<(hwlib::ostream &os, const message &message) {
+        friend hwlib::ostream &operator<<(hwlib::ostream &os, const basic_message &message) {
             os << "type:" << message.type << " message_id:" << message.message_id << " sender:" << hwlib::hex
                << message.sender
-               << " receiver: " << message.receiver << " dataSize:" << hwlib::dec << message.dataSize
-               << " connectionData:"
-               << message.connectionData[0] << " - ";
+               << " receiver: " << message.receiver << " hop_limit:" << hwlib::dec << message.hop_limit
+               << " dataSize:" << message.dataSize
+               << " connectionData:";
+            for (size_t i = 0; i < connection_data_size; i++) {
+                os << message.connectionData[i] << " ";
+            }
+            os << "- ";
 
             for (size_t i = 0; i < message.dataSize; i++) {
                 os << message.data[i] << " ";
@@ -150,6 +225,142 @@ namespace mesh {
 
 #endif
     };
+
+    /**
+     * \brief Non-owning view over a serialized message
+     *
+     * Gives access to the fields of a message directly on the received frame bytes, so a frame doesn't need to be parsed before it is used.
+     * A view doesn't own its bytes, it is only valid as long as the memory it points to is.
+     * Relayed messages can be passed on as a view, without ever being copied into a message.
+     *
+     * @tparam traits Message layout, see message_traits
+     */
+    template<typename traits>
+    class basic_message_view {
+        typedef basic_message<traits> message_t;
+
+        uint8_t *bytes;
+        size_t n;
+
+    public:
+        /// Type used to store the payload size
+        typedef typename message_t::size_type size_type;
+
+        /**
+         * Make an empty (invalid) view
+         */
+        basic_message_view() : bytes(nullptr), n(0) {}
+
+        /**
+         * Create a view over a serialized message
+         * @param bytes Memory location of the serialized message
+         * @param n Size of the serialized message
+         */
+        basic_message_view(uint8_t *bytes, size_t n) : bytes(bytes), n(n) {}
+
+        /**
+         * \brief Check if the viewed bytes are large enough to contain a message
+         * @return True if the view can be read, false otherwise
+         */
+        bool is_valid() const {
+            return bytes != nullptr && n >= message_t::header_size + message_t::connection_data_size;
+        }
+
+        /// Type of the message, see definitions.h
+        message_type type() const {
+            return bytes[0];
+        }
+
+        /// ID of the message
+        uint8_t message_id() const {
+            return bytes[1];
+        }
+
+        /// Node_id of the sender of the message
+        node_id sender() const {
+            return bytes[2];
+        }
+
+        /// Receiver of the message, messages with receiver 0 are assumed to be a broadcast
+        node_id receiver() const {
+            return bytes[3];
+        }
+
+        /// Remaining amount of hops of the message
+        uint8_t hop_limit() const {
+            return bytes[4];
+        }
+
+        /**
+         * \brief Change the hop limit in the viewed bytes, so a relayed message can be passed on without copying it
+         * @param limit New hop limit
+         */
+        void set_hop_limit(uint8_t limit) {
+            bytes[4] = limit;
+        }
+
+        /// Size of the payload of this message
+        size_type data_size() const {
+            size_type size = 0;
+            for (size_t i = 0; i < sizeof(size_type); i++) {
+                size |= size_type(bytes[5 + i] << (8 * i));
+            }
+            return size;
+        }
+
+        /// Start of the payload of this message, data_size() bytes long
+        const uint8_t *data() const {
+            return bytes + message_t::header_size;
+        }
+
+        /// Additional data, used for connectivity method specific interaction. Index should be lower than the layout's connection_data_size
+        uint8_t connection_data(size_t index) const {
+            return bytes[n - message_t::connection_data_size + index];
+        }
+
+        /**
+         * \brief Get the bytesize of the viewed message
+         * @return The bytesize
+         */
+        size_t size() const {
+            return n;
+        }
+
+        /**
+         * \brief Get the serialized message
+         *
+         * These are the exact bytes that were received, and can be transmitted as-is to relay the message.
+         * @return Memory location of the serialized message
+         */
+        uint8_t *begin() const {
+            return bytes;
+        }
+
+        /**
+         * \brief Copy the viewed message into a message
+         *
+         * @param out Message to write to
+         * @return True if the view was a valid message, false otherwise
+         */
+        bool copy_to(message_t &out) const {
+            return out.parse(n, bytes);
+        }
+    };
+
+/**
+ * \brief Message layout used by this library
+ *
+ * Defaults to message_traits::nrf24. When all nodes use a connection method with larger frames, define MESH_MESSAGE_TRAITS as another layout before including the library.
+ * Connectivity adapters check at compile time that the chosen layout fits their frames.
+ */
+#ifndef MESH_MESSAGE_TRAITS
+#define MESH_MESSAGE_TRAITS mesh::message_traits::nrf24
+#endif
+
+    /// \brief Message using the layout chosen for this build
+    typedef basic_message<MESH_MESSAGE_TRAITS> message;
+    /// \brief Message view using the layout chosen for this build
+    typedef basic_message_view<MESH_MESSAGE_TRAITS> message_view;
 }
 
 #endif //IPASS_MESH_MESSAGE_HPP
@@ -24,6 +24,19 @@ namespace mesh {
      * \addtogroup mesh_networking
      * @{
      */
+    /**
+     * \brief Interface for being informed of changes in a router's routes
+     */
+    class route_listener {
+    public:
+        /**
+         * \brief Called when a router found a new route, or a route changed
+         *
+         * This can be called while the router is handling a message, so it should only note the change.
+         */
+        virtual void on_routes_changed() = 0;
+    };
+
     /**
      * \brief Class for routing implementations
      *
@@ -34,6 +47,17 @@ namespace mesh {
     protected:
         /// \brief Connectivity Adapter to use for this router
         connectivity_adapter &connectivity;
+        /// \brief Listener to inform of route changes, can be nullptr
+        route_listener *listener = nullptr;
+
+        /**
+         * \brief Inform the route_listener that routes changed, implementations should call this when they find a new route
+         */
+        void routes_changed() {
+            if (listener != nullptr) {
+                listener->on_routes_changed();
+            }
+        }
     public:
         /**
          * Create a router using the given connectivity adapter
@@ -46,8 +70,10 @@ namespace mesh {
          *
          * This method doesn't need to transmit anything.
          * When caching neighbours isn't needed, this function can just be left.
+         * mesh_network calls this periodically, and sends an update when it returns true.
+         * @return True if the neighbour information changed enough that the network should be updated
          */
-        virtual void update_neighbours() {};
+        virtual bool update_neighbours() { return false; };
 
         /**
          * \brief Send update message into network, containing the current neighbour information
@@ -59,7 +85,8 @@ namespace mesh {
         /**
          * \brief Send the first update message, after connecting
          *
-         * Other nodes should respond to these messages with their own neighbour information.
+         * Other nodes should respond to these messages with their own neighbour information, preferably sent to the requesting node only.
+         * mesh_network calls this on both nodes of a new connection, so a node that restarted always announces itself, whichever side it is on.
          */
         virtual void initial_update() {};
 
@@ -68,16 +95,80 @@ namespace mesh {
          *
          * @param message Message to handle
          */
-        virtual void on_routing_message(message &message) {};
+        virtual void on_routing_message(message &) {};
+
+        /**
+         * \brief Handle another copy of a flooded routing message, that the connectivity adapter already received before
+         *
+         * Flooding routers can use this to pass a message on after all, when an earlier copy came from a node it shouldn't be passed on for.
+         * @param message The copy, with the relay information of the node it came from
+         */
+        virtual void on_duplicate_routing_message(message &) {};
+
+        /**
+         * \brief Do periodic work, like deferred route calculations
+         *
+         * mesh_network calls this on every update.
+         */
+        virtual void update() {};
 
         /**
          * \brief Run the routing algorithm, and calculate the next hop for the given node_id
          * @param receiver Node_id to find the next hop for
          * @return The id of the next_hop, or 0 if none was found
          */
-        virtual node_id get_next_hop(const node_id &receiver) {
+        virtual node_id get_next_hop(const node_id &) {
             return 0;
         };
+
+        /**
+         * \brief Get the next hops of all equally short paths to a destination
+         *
+         * The first next hop is the one get_next_hop returns. Routers that only know a single path don't need to override this.
+         * @param receiver Final destination to get next hops for
+         * @param next_hops Array to store the next hops in
+         * @param max_count Size of next_hops
+         * @return Amount of next hops stored, 0 if there is no route
+         */
+        virtual size_t get_next_hops(const node_id &receiver, node_id next_hops[], size_t max_count) {
+            node_id next_hop = get_next_hop(receiver);
+            if (next_hop == 0 || max_count == 0) {
+                return 0;
+            }
+            next_hops[0] = next_hop;
+            return 1;
+        };
+
+        /**
+         * \brief Get a neighbour that can take over when the next hop to a destination fails
+         *
+         * The backup hop should be calculated beforehand, so a message can be sent to it right away when the next hop doesn't respond,
+         * without waiting for the routing information to converge. It should never send the message back to this node.
+         * @param receiver Final destination to get the backup hop for
+         * @return The backup hop, or 0 if there is none
+         */
+        virtual node_id get_backup_hop(const node_id &) {
+            return 0;
+        };
+
+        /**
+         * \brief Handle a message for which get_next_hop found no next hop
+         *
+         * Routers that find routes on demand can hold on to the message, and send it themselves once a route is found.
+         * @param message Message that couldn't be routed, with its sender set
+         * @return True if the router took the message, false if it is dropped
+         */
+        virtual bool on_unroutable(const message &) {
+            return false;
+        };
+
+        /**
+         * \brief Set the listener to inform when routes change
+         * @param routeListener Listener to inform
+         */
+        void set_route_listener(route_listener &routeListener) {
+            listener = &routeListener;
+        }
     };
 
     /**
@@ -0,0 +1,300 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_AODV_ROUTER_HPP
+#define IPASS_AODV_ROUTER_HPP
+
+#include <mesh/router.hpp>
+
+namespace mesh {
+    namespace routers {
+        /**
+         * \addtogroup routers
+         * @{
+         */
+
+        /**
+         * \brief Router implementation that finds routes on demand (AODV)
+         *
+         * Nothing is sent while there is no traffic. When get_next_hop has no route, a ROUTE_REQUEST is flooded through the network.
+         * The destination, or a node with a recent enough route to it, answers with a ROUTE_REPLY, which travels back hop by hop.
+         * Every node that passes the request or reply on learns a route to its originator.
+         * Messages sent while a route is being discovered are buffered (see on_unroutable), and sent as soon as the route is known.
+         * A discovery is retried max_discovery_attempts times, with a doubling timeout. After that, its buffered messages are dropped.
+         *
+         * Routes are kept in a bounded cache, and expire when they are not used for active_route_timeout ticks.
+         * When a next hop is lost (see update_neighbours), its routes break and a ROUTE_ERROR is sent to all neighbours.
+         * Neighbours invalidate their routes through the sender of the error, and pass the error on.
+         * Like in DSDV, destination sequence numbers make sure that routes that broke are not used again.
+         *
+         * Every routing message is sent by the previous hop itself, so the message sender is always a neighbour.
+         * ROUTE_REQUEST data: originator, originator sequence number, request id, destination, destination sequence number, hop count, flags
+         * ROUTE_REPLY data: originator (of the request), destination, destination sequence number, hop count
+         * ROUTE_ERROR data: pairs of destination and destination sequence number
+         *
+         * This class doesn't own the route cache and message buffer, use aodv_router to create a router with storage.
+         */
+        class aodv : public router {
+        public:
+            /// Amount of ticks a route stays valid without being used
+            static constexpr const uint16_t active_route_timeout = 3000;
+            /// Amount of ticks to wait for a reply to the first route request, doubled on every retry
+            static constexpr const uint16_t discovery_timeout = 100;
+            /// Maximum amount of route requests per discovery
+            static constexpr const uint8_t max_discovery_attempts = 3;
+            /// Maximum amount of destinations that are discovered at the same time
+            static constexpr const size_t max_discoveries = 4;
+            /// Maximum amount of hops a route request travels
+            static constexpr const uint8_t max_hops = 16;
+            /// Amount of ticks a route request is remembered, to ignore copies of it
+            static constexpr const uint16_t request_memory = 200;
+            /// Route request flag: the destination sequence number is not known
+            static constexpr const uint8_t UNKNOWN_SEQUENCE = 0x01;
+
+            /**
+             * \brief Cached route to a single destination
+             */
+            struct route_entry {
+                /// Destination of the route, 0 if the entry is unused
+                node_id destination = 0;
+                /// First hop on the route
+                node_id next_hop = 0;
+                /// Amount of hops to the destination
+                uint8_t hop_count = 0;
+                /// Newest known sequence number of the destination
+                uint8_t sequence = 0;
+                /// False when no sequence number of the destination is known
+                bool sequence_known = false;
+                /// True when the route can be used
+                bool valid = false;
+                /// True when the route broke, and a ROUTE_ERROR still needs to be sent
+                bool broken = false;
+                /// Amount of ticks until the route expires
+                uint16_t lifetime = 0;
+            };
+
+            /**
+             * \brief Message waiting for a route
+             */
+            struct buffered_message {
+                /// True when the slot holds a message
+                bool in_use = false;
+                /// The message
+                message msg;
+            };
+
+        private:
+            /**
+             * \brief Route discovery in progress
+             */
+            struct discovery {
+                /// Destination to find a route to, 0 if unused
+                node_id destination = 0;
+                /// Amount of route requests that were sent
+                uint8_t attempts = 0;
+                /// Amount of ticks until the next attempt
+                uint16_t wait = 0;
+            };
+
+            /**
+             * \brief Route request that was already handled
+             */
+            struct seen_request {
+                /// Originator of the request, 0 if unused
+                node_id originator = 0;
+                uint8_t request_id = 0;
+                /// Amount of ticks since the request was seen
+                uint16_t age = 0;
+            };
+
+            size_t route_count;
+            size_t buffer_count;
+            /// Sequence number of this node
+            uint8_t sequence = 0;
+            /// Id of the last route request sent by this node
+            uint8_t request_id = 0;
+            std::array<discovery, max_discoveries> discoveries = {};
+            std::array<seen_request, 8> seen_requests = {};
+
+            /**
+             * \brief Find the cache entry of a destination
+             * @param destination Destination of the route
+             * @return The entry (which might not be valid), or nullptr if there is none
+             */
+            route_entry *find(const node_id &destination);
+
+            /**
+             * \brief Get a valid route to a destination
+             * @param destination Destination of the route
+             * @return The route, or nullptr if there is no valid route
+             */
+            route_entry *find_valid(const node_id &destination);
+
+            /**
+             * \brief Store a route, if it is newer or shorter than the known route
+             *
+             * When a cache entry is needed and the cache is full, the route closest to expiring is replaced.
+             * Its discovery is finished, and buffered messages that can be sent now are sent.
+             * @param destination Destination of the route
+             * @param next_hop First hop on the route
+             * @param hop_count Amount of hops to the destination
+             * @param route_sequence Sequence number of the destination
+             * @param sequence_known False if route_sequence is not a real sequence number
+             */
+            void update_route(const node_id &destination, const node_id &next_hop, uint8_t hop_count,
+                              uint8_t route_sequence, bool sequence_known);
+
+            /**
+             * \brief Remember a route request, so copies of it are ignored
+             * @param originator Originator of the request
+             * @param id Request id
+             * @return False if the request was already seen
+             */
+            bool remember_request(const node_id &originator, uint8_t id);
+
+            /**
+             * \brief Start looking for a route, unless a discovery for the destination is already running
+             * @param destination Destination to find a route to
+             * @return False if there is no room for another discovery
+             */
+            bool start_discovery(const node_id &destination);
+
+            /**
+             * \brief Flood a route request for a discovery
+             * @param search The discovery
+             */
+            void send_request(discovery &search);
+
+            /**
+             * \brief Send a route reply one hop back towards the originator of a request
+             * @param originator Originator of the request
+             * @param destination Destination of the route
+             * @param route_sequence Sequence number of the destination
+             * @param hop_count Amount of hops from this node to the destination
+             */
+            void send_reply(const node_id &originator, const node_id &destination, uint8_t route_sequence,
+                            uint8_t hop_count);
+
+            /**
+             * \brief Send a ROUTE_ERROR for all broken routes
+             */
+            void send_errors();
+
+            /**
+             * \brief Send the buffered messages whose receiver is a neighbour, or has a valid route
+             *
+             * Messages stay buffered until the connectivity adapter accepts them.
+             */
+            void flush_buffer();
+
+            void handle_request(const message &message);
+
+            void handle_reply(const message &message);
+
+            void handle_error(const message &message);
+
+        protected:
+            /// Array of route_count routes. Set by the class providing the storage
+            route_entry *routes = nullptr;
+            /// Array of buffer_count message slots. Set by the class providing the storage
+            buffered_message *buffer = nullptr;
+
+            /**
+             * \brief Create an AODV router, storage should be set by the subclass
+             * @param connectivity Connectivity adapter to send messages through
+             * @param route_count Size of the route cache
+             * @param buffer_count Amount of messages that can wait for a route
+             */
+            aodv(connectivity_adapter &connectivity, size_t route_count, size_t buffer_count);
+
+        public:
+            /**
+             * \brief Break all routes whose next hop is no longer a neighbour
+             * @return True if a route broke
+             */
+            bool update_neighbours() override;
+
+            /**
+             * \brief Send a ROUTE_ERROR for routes that broke
+             *
+             * There are no periodic updates, mesh_network calls this when a neighbour was lost.
+             */
+            void send_update() override;
+
+            /**
+             * \brief Handle a routing message from a neighbour
+             * @param message Message to handle
+             */
+            void on_routing_message(message &message) override;
+
+            /**
+             * \brief Age routes and remembered requests, and retry or give up discoveries
+             */
+            void update() override;
+
+            /**
+             * \brief Get the next hop for a given destination
+             *
+             * Using a route extends its lifetime. When there is no route, a discovery is started.
+             * @param receiver Final destination to get next hop for
+             * @return The next hop, or 0 if there is no route (yet)
+             */
+            node_id get_next_hop(const node_id &receiver) override;
+
+            /**
+             * \brief Buffer a message until a route to its receiver is found
+             * @param message Message that couldn't be routed
+             * @return False if the buffer is full, or no discovery could be started
+             */
+            bool on_unroutable(const message &message) override;
+
+            /**
+             * \brief Get the size of the route cache
+             * @return The route count
+             */
+            size_t get_route_count() const;
+
+            /**
+             * \brief Get a route cache entry by its index
+             * @param index Index of the entry, lower than get_route_count()
+             * @return The entry, its destination is 0 if it is unused
+             */
+            const route_entry &get_route(size_t index) const;
+        };
+
+        /**
+         * \brief AODV router with its own route cache and message buffer
+         *
+         * @tparam max_routes Size of the route cache
+         * @tparam max_buffered Amount of messages that can wait for a route
+         */
+        template<size_t max_routes, size_t max_buffered>
+        class aodv_router : public aodv {
+            std::array<route_entry, max_routes> route_cache;
+            std::array<buffered_message, max_buffered> message_buffer;
+
+        public:
+            /**
+             * \brief Create an AODV router
+             * @param connectivity Connectivity adapter to send messages through
+             */
+            explicit aodv_router(connectivity_adapter &connectivity) :
+                    aodv(connectivity, max_routes, max_buffered), route_cache(), message_buffer() {
+                routes = route_cache.data();
+                buffer = message_buffer.data();
+            }
+        };
+
+        /**
+         * @}
+         */
+    }
+}
+
+#endif //IPASS_AODV_ROUTER_HPP
@@ -0,0 +1,215 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_DISTANCE_VECTOR_ROUTER_HPP
+#define IPASS_DISTANCE_VECTOR_ROUTER_HPP
+
+#include <mesh/router.hpp>
+
+namespace mesh {
+    namespace routers {
+        /**
+         * \addtogroup routers
+         * @{
+         */
+
+        /**
+         * \brief Router implementation using a distance vector algorithm (DSDV)
+         *
+         * Every node only keeps a route (next hop, metric and sequence number) per destination, and only talks to its neighbours.
+         * This needs much less memory and processing than link_state, but takes longer to converge.
+         *
+         * Metrics are the sum of the measured link costs (see connectivity_adapter::link_cost), infinity means unreachable.
+         * Every node advertises itself with an even sequence number, which it increases on every complete update.
+         * When a node loses a neighbour, its routes through that neighbour become infinite, with an odd sequence number one higher than before.
+         * A node that hears about a route to itself with a sequence number as new as its own, increases its own sequence number past it, and sends a triggered update.
+         * A route is replaced by one with a newer sequence number, or by one with the same sequence number and a lower metric.
+         * Advertisements from the current next hop of a route are always taken over, since they describe the path that is used.
+         * When a neighbour advertises an older sequence number than the known route, the known route is sent in the next triggered update.
+         * Since an infinite route has a newer sequence number than the route it replaces, stale routes can't come back through other neighbours (count to infinity).
+         *
+         * Changed routes are sent to all neighbours from update() (triggered updates), so several changes are combined in one message.
+         * A complete update is sent every full_update_interval ticks, and when neighbours change.
+         * Routing information in messages is sent in data, as entries of 3 bytes:
+         * 1st byte: destination
+         * 2nd byte: sequence number
+         * 3rd byte: metric
+         * etc...
+         *
+         * This class doesn't own the routing table, use distance_vector_router to create a router with storage.
+         */
+        class distance_vector : public router {
+        public:
+            /// Metric of an unreachable destination
+            static constexpr const uint8_t infinity = 255;
+            /// Size of a single routing table entry in a message
+            static constexpr const size_t entry_size = 3;
+            /// Maximum amount of routing table entries in a single message
+            static constexpr const size_t entries_per_message = message::payload_size / entry_size;
+            /// Amount of update() calls (ticks) between complete updates
+            static constexpr const uint16_t full_update_interval = 1000;
+            /// Minimum change of a link cost, in percent of the current cost, before the route to a neighbour changes
+            static constexpr const uint8_t cost_hysteresis_percent = 25;
+
+            /**
+             * \brief Route to a single destination
+             */
+            struct route_entry {
+                /// Destination of the route, 0 if the entry is unused
+                node_id destination = 0;
+                /// First hop on the route
+                node_id next_hop = 0;
+                /// Cost of the route, or infinity
+                uint8_t metric = infinity;
+                /// Sequence number of the destination that this route is based on
+                uint8_t sequence = 0;
+                /// True when the route changed since it was last sent to the neighbours
+                bool changed = false;
+            };
+
+        private:
+            size_t table_size;
+            /// Sequence number of this node
+            uint8_t sequence = 0;
+            /// True when a route changed, and a triggered update should be sent
+            bool triggered = false;
+            uint16_t ticks_since_full_update = 0;
+
+            /**
+             * \brief Find the route to a destination
+             * @param destination Destination of the route
+             * @return The route, or nullptr if the destination is unknown
+             */
+            route_entry *find(const node_id &destination);
+
+            /**
+             * \brief Claim an entry for a new destination
+             *
+             * Uses an unused entry, or an unreachable route that was already sent to the neighbours.
+             * @param destination Destination of the route
+             * @return The entry, or nullptr if the table is full
+             */
+            route_entry *add(const node_id &destination);
+
+            /**
+             * \brief Update a route, and mark it for a triggered update if anything but the sequence number changed
+             * @param route Route to update
+             * @param next_hop New next hop
+             * @param metric New metric
+             * @param route_sequence New sequence number
+             */
+            void set_route(route_entry &route, const node_id &next_hop, uint8_t metric, uint8_t route_sequence);
+
+            /**
+             * \brief Handle the routing table entries in a message from a neighbour
+             * @param message Message with entries, see class documentation for the format
+             */
+            void process_entries(const message &message);
+
+            /**
+             * \brief Send this node's own entry, and the routes in the table to all neighbours
+             * @param type Message type of the first message, the other messages are sent as DISTANCE_VECTOR_ROUTING::UPDATE
+             * @param changed_only True to only send routes that changed since they were last sent
+             */
+            void send_entries(const message_type &type, bool changed_only);
+
+        protected:
+            /// Array of table_size routes. Set by the class providing the storage
+            route_entry *routes = nullptr;
+
+            /**
+             * \brief Create a distance vector router, storage should be set by the subclass
+             * @param connectivity Connectivity adapter to send messages through
+             * @param table_size Maximum amount of destinations
+             */
+            distance_vector(connectivity_adapter &connectivity, size_t table_size);
+
+        public:
+            /**
+             * \brief Update the routes to the direct neighbours
+             *
+             * Routes through nodes that are no longer a neighbour become infinite. Routes to new neighbours are added,
+             * and the route to a neighbour changes when its link cost changes at least cost_hysteresis_percent.
+             * @return True if a neighbour was added or removed, or a cost changed
+             */
+            bool update_neighbours() override;
+
+            /**
+             * \brief Send all routes to all neighbours
+             *
+             * Increases the sequence number of this node.
+             */
+            void send_update() override;
+
+            /**
+             * \brief Send all routes to all neighbours, requesting their routes
+             */
+            void initial_update() override;
+
+            /**
+             * \brief Handle a routing message from a neighbour
+             *
+             * Messages from nodes that aren't a neighbour are ignored. Routing messages are never passed on.
+             * @param message Message to handle
+             */
+            void on_routing_message(message &message) override;
+
+            /**
+             * \brief Send triggered and periodic updates
+             */
+            void update() override;
+
+            /**
+             * \brief Get the next hop for a given destination
+             * @param receiver Final destination to get next hop for
+             * @return The next hop, or 0 if the destination is unknown or unreachable
+             */
+            node_id get_next_hop(const node_id &receiver) override;
+
+            /**
+             * \brief Get the maximum amount of destinations
+             * @return The table size
+             */
+            size_t get_table_size() const;
+
+            /**
+             * \brief Get a routing table entry by its index
+             * @param index Index of the entry, lower than get_table_size()
+             * @return The entry, its destination is 0 if it is unused
+             */
+            const route_entry &get_route(size_t index) const;
+        };
+
+        /**
+         * \brief Distance vector router with its own routing table
+         *
+         * @tparam max_destinations Maximum amount of destinations in the routing table
+         */
+        template<size_t max_destinations>
+        class distance_vector_router : public distance_vector {
+            std::array<route_entry, max_destinations> table;
+
+        public:
+            /**
+             * \brief Create a distance vector router
+             * @param connectivity Connectivity adapter to send messages through
+             */
+            explicit distance_vector_router(connectivity_adapter &connectivity) :
+                    distance_vector(connectivity, max_destinations), table() {
+                routes = table.data();
+            }
+        };
+
+        /**
+         * @}
+         */
+    }
+}
+
+#endif //IPASS_DISTANCE_VECTOR_ROUTER_HPP
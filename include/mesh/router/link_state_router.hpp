@@ -11,11 +11,9 @@
 #define IPASS_LINK_STATE_ROUTER_HPP
 
 #include <mesh/router.hpp>
-#include <link_state/calculator.hpp>
+#include <mesh/router/link_state_topology.hpp>
 
-using link_state::calculator;
-using link_state::node;
-namespace mesh { //Todo: Pagination for shitloads of nodes
+namespace mesh {
     namespace routers {
         /**
          * \addtogroup routers
@@ -25,53 +23,293 @@ namespace mesh { //Todo: Pagination for shitloads of nodes
         /**
          * \brief Router implementation using the link_state algorithm
          *
-         * To conserve processing time, this router only calculates when a message needs to be routed. This may increase delay in messages.
+         * The shortest path tree is updated incrementally whenever the node graph changes (see link_state_topology), so finding a next hop is only a lookup.
+         * Alternatively, calculation can be debounced with set_recalculation_delay: changes are then collected, and the tree is calculated once from update().
+         * The node graph is stored in a link_state_topology that is passed to the router, so its size can be chosen per network.
          * Routing information in messages is sent in data, and formatted as follows:
-         * 1st byte: neighbour1.node_id
-         * 2nd byte: neighbour1.connection_cost
-         * 3rd byte: neighbour2.node_id
+         * 1st byte: sequence number
+         * 2nd byte: age
+         * 3rd byte: page index
+         * 4th byte: page count
+         * 5th byte: relay, the node that sent this copy
+         * 6th byte: neighbour1.node_id
+         * 7th byte: neighbour1.connection_cost
+         * 8th byte: neighbour2.node_id
          * etc...
+         *
+         * When a node has more neighbours than fit in one message (edges_per_page), its neighbour list is sent in multiple pages (at most max_pages).
+         * Page i holds the neighbours starting at i * edges_per_page. The last page also ends the list.
+         * A page is only used when all neighbours before it are known. Otherwise, the pages received so far are forgotten,
+         * and a RESYNC_REQUEST is sent to the originator, which answers with a complete update.
+         *
+         * Every update gets a new sequence number, which is the same for all of its pages.
+         * For every originator, the router remembers the newest sequence number, and which of its pages were received.
+         * Only pages of a newer update, or pages of the newest update that weren't received yet, are used and passed on. Everything else is dropped.
+         * The age counts the hops an update travelled, an update is not passed on once it reaches max_age.
+         * An UPDATE_REQUEST is sent by both nodes of a new connection, since one of them might have restarted its sequence number.
+         * Therefore it is accepted with any sequence number different from the newest one.
+         * Other nodes answer it by sending the pages of their newest update to the requester only, with the same sequence number,
+         * so a new connection floods only the two requests. Only a node whose own neighbours changed since its newest update floods a new update instead.
+         *
+         * When only a few neighbours changed since the previous update, an UPDATE_DELTA is sent instead, formatted as follows:
+         * 1st byte: sequence number
+         * 2nd byte: age
+         * 3rd byte: base sequence number, the update this delta applies to
+         * 4th byte: relay, the node that sent this copy
+         * 5th byte: neighbour1.node_id
+         * 6th byte: neighbour1.connection_cost, or 0 if the neighbour was removed
+         * etc...
+         * A delta is only applied when all pages of its base update were received, otherwise a RESYNC_REQUEST is sent to the originator.
+         * The originator answers that with a complete update.
+         *
+         * To reduce the amount of transmissions per flood, updates and deltas are only passed on by multipoint relays (as in OLSR).
+         * Every node selects a small set of neighbours that together reach all of its 2-hop neighbours (see link_state_topology::select_relays),
+         * and sends the selection to its neighbours in an MPR_SELECT message, which contains the ids of the selected neighbours.
+         * A node passes an update or delta on once, as soon as any copy of it comes from a relay that selected it,
+         * so a copy from a relay that didn't select it doesn't stop a later copy from one that did (the forwarding rule of OLSR).
+         * Later copies are compared by originator and sequence number, the mesh_network hands them over with on_duplicate_routing_message.
+         * As long as a node doesn't know whether the relay selected it (for example because the relay is a new neighbour), it passes the update on.
          */
         class link_state : public router {
-            bool is_updated = false;
-            calculator<node_id, uint8_t, 5, 10> ls_calc;
+        public:
+            /// Minimum change of a link cost, in percent of the advertised cost, before the new cost is advertised
+            static constexpr const uint8_t cost_hysteresis_percent = 25;
+            /// Size of the sequence number, age, page and relay fields in an update message
+            static constexpr const size_t update_header_size = 5;
+            /// Maximum amount of neighbours in a single update message
+            static constexpr const size_t edges_per_page = (message::payload_size - update_header_size) / 2;
+            /// Maximum amount of pages in an update
+            static constexpr const uint8_t max_pages = 16;
+            /// Amount of hops after which an update is no longer passed on
+            static constexpr const uint8_t max_age = 32;
+            /// Size of the sequence number, age, base sequence number and relay fields in a delta message
+            static constexpr const size_t delta_header_size = 4;
+            /// Maximum amount of changed neighbours in a delta, more changes are sent as a complete update
+            static constexpr const size_t max_delta_changes = (message::payload_size - delta_header_size) / 2 < 16 ?
+                                                              (message::payload_size - delta_header_size) / 2 : 16;
+            /// Maximum amount of multipoint relays, so the selection fits in a single MPR_SELECT message
+            static constexpr const size_t max_relays = message::payload_size;
+
+        private:
+            /**
+             * \brief Whether a neighbour selected this node as multipoint relay
+             */
+            enum relay_selection : uint8_t {
+                RELAY_UNKNOWN,
+                RELAY_SELECTED,
+                RELAY_NOT_SELECTED
+            };
+
+            /**
+             * \brief Newest update received from an originator
+             */
+            struct advertisement_record {
+                /// True when an update from this originator was received
+                bool known = false;
+                /// Sequence number of the newest update
+                uint8_t sequence = 0;
+                /// Bit i is set when page i of the newest update was received
+                uint16_t pages = 0;
+                /// Page count of the newest update, 0 if its neighbours are not completely known
+                uint8_t page_count = 0;
+                /// Bit i is set when page i of the newest update was passed on, bit 0 when the newest sequence number is a delta
+                uint16_t relayed_pages = 0;
+
+                /**
+                 * \brief Check if the neighbours of the newest update are completely known
+                 * @return True if all pages were received
+                 */
+                bool complete() const {
+                    return page_count != 0 && pages == (1u << page_count) - 1;
+                }
+            };
+
+            /**
+             * \brief Neighbour of this node that changed since the previous update
+             */
+            struct edge_change {
+                /// The neighbour
+                node_id neighbour;
+                /// New cost of the edge, or 0 if it was removed
+                uint8_t cost;
+            };
+
+            link_state_topology &topology;
+            /// Amount of update() calls to collect changes before calculating, 0 to calculate on every change
+            uint16_t recalculation_delay = 0;
+            /// Amount of update() calls since the node graph became dirty
+            uint16_t dirty_ticks = 0;
+            /// Sequence number of the next update sent by this node
+            uint8_t sequence = 0;
+            /// Newest update of every originator, indexed by node_id
+            std::array<advertisement_record, 256> advertisements = {};
+            /// True once this node sent a complete update, deltas are only sent after that
+            bool advertised = false;
+            std::array<edge_change, max_delta_changes> pending_changes = {};
+            size_t pending_count = 0;
+            /// True when more neighbours changed than fit in a delta
+            bool pending_overflow = false;
+            /// Neighbours selected as multipoint relay by this node
+            std::array<node_id, max_relays> relays = {};
+            size_t relay_count = 0;
+            /// True once relays were selected, before that no MPR_SELECT is sent
+            bool relays_selected = false;
+            /// True when edges changed since the relays were selected
+            bool relays_outdated = false;
+            /// True when the selection couldn't be queued for all neighbours, it is sent again from update()
+            bool relays_unsent = false;
+            /// Per neighbour, whether it selected this node as multipoint relay
+            std::array<relay_selection, 256> relay_states = {};
+            /// Amount of received updates that were passed on
+            uint16_t relayed_count = 0;
+            /// Amount of received copies of updates that weren't passed on, because their relay didn't select this node
+            uint16_t suppressed_count = 0;
+
+            /**
+             * \brief Select the multipoint relays again, and send the selection when it changed
+             */
+            void update_relays();
+
+            /**
+             * \brief Send the selected multipoint relays to all neighbours, as an MPR_SELECT message
+             */
+            void send_relays();
+
+            /**
+             * \brief Pass a received update or delta on to all neighbours, if this node was selected as relay for it and didn't pass it on yet
+             * @param message A copy of the newest update or delta of its originator
+             * @param relay_index Index of the relay field in the message
+             */
+            void relay_update(message &message, size_t relay_index);
+
+            /**
+             * \brief Check if an update or delta has the newest sequence number of its originator
+             * @param message The update or delta
+             * @return True if the message is valid, and a copy of the newest update or delta
+             */
+            bool is_newest(const message &message) const;
+
+            /**
+             * \brief Remember a changed neighbour for the next delta
+             * @param neighbour The neighbour
+             * @param cost New cost of the edge, or 0 if it was removed
+             */
+            void record_change(const node_id &neighbour, uint8_t cost);
+
+            /**
+             * \brief Send the changed neighbours to all neighbours, as an UPDATE_DELTA
+             */
+            void send_delta();
+
+            /**
+             * \brief Apply the changes in a delta to the node graph
+             * @param other Node the delta came from
+             * @param message The delta, see class documentation for the format
+             */
+            void graph_apply_delta(const node_id &other, const message &message);
+
+            /**
+             * \brief Check if a delta is new, and apply it if its base update is known
+             *
+             * When the base update is not known, a RESYNC_REQUEST is sent to the originator.
+             * @param message The delta
+             * @return True if the delta should be passed on, false if it is a duplicate or stale
+             */
+            bool accept_delta(const message &message);
+
+            /**
+             * \brief Forget the received pages of an originator, and request a complete update from it
+             *
+             * Sends a RESYNC_REQUEST towards the originator, if it is reachable.
+             * @param originator Node to request the update from
+             */
+            void request_resync(const node_id &originator);
+
+            /**
+             * \brief Check if an update page is new
+             *
+             * A page of a newer update replaces the record of the originator. See the class documentation for the rules.
+             * @param message The update
+             * @return True if the page should be used and passed on, false if it is a duplicate or stale
+             */
+            bool accept_advertisement(const message &message);
+
+            /**
+             * \brief Save an accepted update page to the node graph, and mark it as received
+             *
+             * A page is only marked once it was applied. When earlier pages are missing, request_resync is used instead.
+             * @param message The update
+             */
+            void use_page(const message &message);
 
             /**
-             * \brief Save updated routing information to the link_state calculator
+             * \brief Save updated routing information to the node graph
              *
-             * Adds a new node if no node with the sender id was found
+             * Adds a new node if no node with the sender id was found.
+             * The page in the message replaces the matching part of the node's neighbour list.
+             * An update with the same edges as before doesn't change the shortest path tree.
              * @param other Node to update information for
              * @param message Message to use for updating, see class documentation for the format
+             * @return False if the page couldn't be used, because neighbours of earlier pages are missing
              */
-            void graph_update_other(const node_id &other, const message &message);
+            bool graph_update_other(const node_id &other, const message &message);
 
             /**
-             * \brief Write the currently known neighbour nodes to a message.
+             * \brief Write a page of the currently known neighbour nodes to a message.
              *
              * This method discards any data that was already in the message
              * @param message Message to add information to
+             * @param page Index of the page to write, lower than page_count()
+             */
+            void fill_update_message(message &message, uint8_t page);
+
+            /**
+             * \brief Get the amount of pages needed to send the currently known neighbour nodes
+             * @return The page count, at least 1
              */
-            void fill_update_message(message &message);
+            uint8_t page_count() const;
+
+            /**
+             * \brief Send all pages of the currently known neighbour nodes to all neighbours
+             * @param first_type Message type of the first page, the other pages are sent as LINK_STATE_ROUTING::UPDATE
+             */
+            void send_pages(const message_type &first_type);
+
+            /**
+             * \brief Send the pages of the newest update again, to a single node
+             *
+             * The pages keep the sequence number of the newest update, so deltas that other nodes apply to it stay valid.
+             * This should only be used when the neighbours didn't change since the newest update.
+             * @param receiver Node to send the pages to
+             * @param relay Neighbour to send through when no route to the receiver is known
+             */
+            void send_newest_pages(const node_id &receiver, const node_id &relay);
 
         public:
             /**
              * \brief Create a link state router
              *
+             * The topology is reset to contain only this node.
              * @param connectivity Connectivity adapter to send messages through
+             * @param topology Storage for the node graph, for example a topology_pool
              */
-            explicit link_state(connectivity_adapter &connectivity);
+            link_state(connectivity_adapter &connectivity, link_state_topology &topology);
 
             /**
              * \brief Update node graph with current neighbours from connectivity adapter
              *
-             * Retrieves the current neighbours using get_neighbours, and updates the graph with their information. Costs need to be calculated here
+             * Retrieves the current neighbours using get_neighbours, and updates the graph with their information.
+             * Edge costs are the measured link costs of the connectivity adapter (see connectivity_adapter::link_cost).
+             * To prevent small fluctuations from flooding the network, a cost only changes when it differs at least cost_hysteresis_percent from the current cost.
+             * @return True if a neighbour was added or removed, or a cost changed
              */
-            void update_neighbours() override;
+            bool update_neighbours() override;
 
             /**
              * \brief Send currently known neighbour information to all nodes in the network
              *
-             * Uses unicast_all, assuming that every node will pass the routing information on to it's neighbours
+             * Uses unicast_all, assuming that every node will pass the routing information on to it's neighbours.
+             * When only a few neighbours changed since the previous update, a single delta is sent. Otherwise, sends one message per page.
              */
             void send_update() override;
 
@@ -83,27 +321,85 @@ namespace mesh { //Todo: Pagination for shitloads of nodes
             /**
              * \brief Handle a routing message
              *
-             * This method updates the node graph when an update message is received, even when the message is not directed at this node
+             * This method updates the node graph when an update message is received, even when the message is not directed at this node.
+             * New updates are passed on to all neighbours with their age increased, duplicate and stale updates are dropped.
              * @param message Message to handle
              */
             void on_routing_message(message &message) override;
 
             /**
-             * \brief Calculate next hop for a given destination
+             * \brief Handle another copy of an update or delta
+             *
+             * A copy of the newest update or delta of its originator is passed on, if that didn't happen for an earlier copy
+             * and this copy comes from a relay that selected this node.
+             * @param message The copy
+             */
+            void on_duplicate_routing_message(message &message) override;
+
+            /**
+             * \brief Calculate the shortest path tree, when the debounce delay has passed since the first uncalculated change
              *
-             * Checks if the algorithm has been run since the last node graph change.
-             * If it hasn't, it is calculated, otherwise the next_hop is found through the graph.
+             * Also recalculates the backup hops and multipoint relays when the topology changed.
+             */
+            void update() override;
+
+            /**
+             * \brief Set the debounce delay for route calculation
+             *
+             * With a delay, changes to the node graph are collected, and the shortest path tree is calculated at once from update(),
+             * delay updates after the first uncalculated change. Until then, the previous routes are used.
+             * With a delay of 0, the tree is updated incrementally on every change.
+             * @param delay Amount of update() calls (ticks) to wait
+             */
+            void set_recalculation_delay(uint16_t delay);
+
+            /**
+             * \brief Get the next hop for a given destination
+             *
+             * Looks the next hop up in the forwarding table, which is always up to date.
              * @param receiver Final destination to get next hop for
              * @return The next hop, or 0 if none was found
              */
             node_id get_next_hop(const node_id &receiver) override;
 
             /**
-             * \brief Get the LinkState Calculator for this router
+             * \brief Get the next hops of all equally short paths to a destination
+             *
+             * See link_state_topology::get_next_hops.
+             * @param receiver Final destination to get next hops for
+             * @param next_hops Array to store the next hops in
+             * @param max_count Size of next_hops
+             * @return Amount of next hops stored, 0 if none was found
+             */
+            size_t get_next_hops(const node_id &receiver, node_id next_hops[], size_t max_count) override;
+
+            /**
+             * \brief Get the loop-free alternate of the next hop to a destination
+             *
+             * Backup hops are recalculated in update(), after the topology changed. See link_state_topology::update_backups.
+             * @param receiver Final destination to get the backup hop for
+             * @return The backup hop, or 0 if there is none
+             */
+            node_id get_backup_hop(const node_id &receiver) override;
+
+            /**
+             * \brief Get the amount of received updates and deltas that were passed on to the neighbours
+             * @return The relayed count, wraps around
+             */
+            uint16_t get_relayed_count() const;
+
+            /**
+             * \brief Get the amount of received copies of updates and deltas that weren't passed on, because their relay didn't select this node
+             * @return The suppressed count, wraps around
+             */
+            uint16_t get_suppressed_count() const;
+
+            /**
+             * \brief Get the node graph of this router
              *
-             * @return The Calculator
+             * @return The node graph, including the distance to every node
              */
-            calculator<node_id, uint8_t, 5, 10> &get_calculator();
+            const link_state_topology &get_topology() const;
 
         };
 
@@ -0,0 +1,339 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_MESH_LINK_STATE_TOPOLOGY_HPP
+#define IPASS_MESH_LINK_STATE_TOPOLOGY_HPP
+
+#include <array>
+#include <mesh/message.hpp>
+
+namespace mesh {
+    namespace routers {
+        /**
+         * \addtogroup routers
+         * @{
+         */
+
+        /**
+         * \brief Network graph of a link state router, with its shortest path tree
+         *
+         * Every node has a list of directed edges, as advertised by that node. Node 0 is always the node running this instance.
+         * The shortest path tree (distance, parent and first hop of every node) is kept up to date incrementally:
+         * when the edges of a node change, only the part of the tree that is affected by those edges is recalculated.
+         * - A cheaper or new edge is relaxed, and only the nodes it improves (and their subtrees) are visited.
+         * - A more expensive or removed edge only matters if it is part of the tree. If it is, the subtree below it is detached, and reattached through the cheapest remaining edges.
+         * Edges of unreachable nodes don't affect the tree at all, and a list of edges that is equal to the current one is ignored.
+         *
+         * In deferred mode, changed edges only mark the graph dirty. The forwarding table keeps its previous results until recalculate is called,
+         * which calculates the whole tree at once. This way, a burst of changes costs a single calculation.
+         * Nodes that are referenced by an edge, but never advertised their own edges, are added without edges.
+         *
+         * The results are stored in a forwarding table with an entry for every possible node_id, so a route lookup is a single array access.
+         * Entries of nodes that are unknown or unreachable have next hop 0 and distance unreachable.
+         *
+         * Together with the backup hops, the first hops of all shortest paths to every node are collected (see get_next_hops),
+         * so spreading traffic over equally short paths doesn't need any calculation per message.
+         *
+         * The forwarding table also holds a loop-free alternate (backup hop) per destination, calculated by update_backups.
+         * A neighbour N is a loop-free alternate for destination D when distance(N, D) < distance(N, this node) + distance(this node, D):
+         * its own shortest path to D doesn't come back through this node, so it can take over right away when the next hop fails.
+         *
+         * This class doesn't own the node storage, use topology_pool to create a graph with storage.
+         * The graph is empty until reset is called.
+         */
+        class link_state_topology {
+        public:
+            /// Distance of a node that can't be reached
+            static constexpr const uint16_t unreachable = 0xFFFF;
+            /// Index of a node that isn't in the graph, also used as parent of nodes without a parent
+            static constexpr const uint8_t no_node = 0xFF;
+
+            /**
+             * \brief Forwarding table entry for a single destination
+             */
+            struct route {
+                /// First hop on the shortest path to the destination
+                node_id next_hop = 0;
+                /// Neighbour (other than next_hop) that can forward to the destination without looping back, 0 if there is none
+                node_id backup_hop = 0;
+                /// Length of the shortest path to the destination
+                uint16_t distance = unreachable;
+            };
+
+            /**
+             * \brief A node in the graph, with its place in the shortest path tree
+             */
+            struct topology_node {
+                /// Neighbours of the node, edge_capacity entries. Set by the class providing the storage
+                node_id *edges = nullptr;
+                /// Cost of the edge to each neighbour, edge_capacity entries. Set by the class providing the storage
+                uint8_t *edge_costs = nullptr;
+                /// Bit i is set when neighbour edges[i] of node 0 is the first hop of a shortest path to the node
+                uint32_t first_hops = 0;
+                /// Id of the node
+                node_id id = 0;
+                /// Amount of edges advertised by the node
+                uint8_t edge_count = 0;
+                /// Index of the previous node on the shortest path
+                uint8_t parent = no_node;
+                /// True when the distance of the node improved, and its edges still need to be relaxed
+                bool queued = false;
+            };
+
+        private:
+            size_t node_capacity;
+            size_t edge_capacity;
+            size_t node_count = 0;
+            bool deferred = false;
+            /// True when edges changed in deferred mode, and the forwarding table is outdated
+            bool dirty = false;
+            /// True when edges changed since the backup hops and first hops were calculated
+            bool backups_outdated = false;
+            /// Index in nodes for every node_id
+            std::array<uint8_t, 256> node_index;
+            /// Forwarding table, indexed by node_id
+            std::array<route, 256> routes = {};
+
+            /**
+             * \brief Find the index of a node
+             * @param id Id of the node
+             * @return The index, or node_capacity if the node isn't in the graph
+             */
+            size_t find(const node_id &id) const {
+                return node_index[id] == no_node ? node_capacity : node_index[id];
+            }
+
+            /**
+             * \brief Find the index of a node, adding it if it isn't in the graph yet
+             * @param id Id of the node
+             * @return The index, or node_capacity if the graph is full
+             */
+            size_t find_or_add(const node_id &id);
+
+            /**
+             * \brief Mark a node, and all nodes whose shortest path runs through it
+             * @param root Index of the node
+             * @param detached Marks, indexed by node index
+             */
+            void detach_subtree(size_t root, bool detached[]) const;
+
+            /**
+             * \brief Try to improve the distance of all neighbours of a node through that node
+             *
+             * Improved neighbours are queued.
+             * @param index Index of the node
+             */
+            void relax(size_t index);
+
+            /**
+             * \brief Relax queued nodes in order of distance, until the queue is empty
+             */
+            void run_queue();
+
+            /**
+             * \brief Collect the first hops of all shortest paths to every node
+             *
+             * Every edge whose length adds up to the distance of the node it ends in is part of a shortest path.
+             * Nodes are visited in order of distance, so a node inherits the first hops of every node before it on such an edge.
+             */
+            void update_first_hops();
+
+            /**
+             * \brief Calculate the length of the shortest path from a node to every node in the graph
+             * @param root Index of the node to start from
+             * @param distance Distance of every node, indexed by node index
+             */
+            void distances_from(size_t root, uint16_t distance[]) const;
+
+        protected:
+            /// Array of node_capacity nodes, each with storage for edge_capacity edges. Set by the class providing the storage
+            topology_node *nodes = nullptr;
+
+            /**
+             * \brief Create a graph, storage should be set by the subclass
+             * @param node_capacity Maximum amount of nodes, including this node. At most 254
+             * @param edge_capacity Maximum amount of edges per node
+             */
+            link_state_topology(size_t node_capacity, size_t edge_capacity);
+
+        public:
+            link_state_topology(const link_state_topology &) = delete;
+
+            link_state_topology &operator=(const link_state_topology &) = delete;
+
+            /**
+             * \brief Remove all nodes, leaving a graph that only contains this node
+             * @param own_id Id of this node
+             */
+            void reset(const node_id &own_id);
+
+            /**
+             * \brief Replace the edges of a node, and update the shortest path tree
+             *
+             * The node is added if it isn't in the graph yet. Edges beyond the edge capacity are ignored.
+             * @param id Node to set the edges for
+             * @param edges Neighbours of the node
+             * @param costs Cost of the edge to each neighbour
+             * @param count Amount of edges
+             * @return True if the edges changed, false if they were equal to the current edges (or the graph is full)
+             */
+            bool set_edges(const node_id &id, const node_id *edges, const uint8_t *costs, size_t count);
+
+            /**
+             * \brief Choose between updating the shortest path tree on every change, or on request
+             *
+             * When leaving deferred mode while the graph is dirty, the tree is recalculated.
+             * @param defer True to only mark the graph dirty on changes, and calculate in recalculate
+             */
+            void set_deferred(bool defer);
+
+            /**
+             * \brief Check if edges changed since the last calculation, in deferred mode
+             * @return True if the forwarding table is outdated
+             */
+            bool is_dirty() const;
+
+            /**
+             * \brief Calculate the complete shortest path tree, and replace the forwarding table
+             */
+            void recalculate();
+
+            /**
+             * \brief Calculate the backup hop and the first hops of every destination, if edges changed since the last calculation
+             *
+             * This runs a shortest path calculation from every neighbour, so it is meant to be called periodically instead of on every change.
+             * While the graph is dirty, nothing is calculated. Until the next calculation, backup hops might be outdated,
+             * and get_next_hops only returns the next hop from the forwarding table.
+             */
+            void update_backups();
+
+            /**
+             * \brief Select multipoint relays: a small set of neighbours that together reach every 2-hop neighbour
+             *
+             * 2-hop neighbours are the nodes in the edge lists of this node's neighbours, that aren't this node or one of its neighbours.
+             * First, neighbours whose edges are unknown, and neighbours that are the only way to reach a 2-hop neighbour are selected.
+             * Then, the neighbour that reaches the most uncovered 2-hop neighbours is added, until all are covered (the greedy heuristic of OLSR).
+             * @param relays Array to store the selected neighbours in
+             * @param max_count Size of relays, neighbours beyond it are not selected
+             * @return Amount of selected neighbours
+             */
+            size_t select_relays(node_id relays[], size_t max_count) const;
+
+            /**
+             * \brief Get the loop-free alternate of the next hop to a node
+             * @param destination Node to find the backup hop for
+             * @return The backup hop, or 0 if there is none
+             */
+            node_id get_backup_hop(const node_id &destination) const {
+                return routes[destination].backup_hop;
+            }
+
+            /**
+             * \brief Get the forwarding table entry of a node
+             * @param destination Node to get the entry for
+             * @return The entry
+             */
+            const route &get_route(const node_id &destination) const {
+                return routes[destination];
+            }
+
+            /**
+             * \brief Get the first hop on the shortest path to a node
+             * @param destination Node to find the next hop for
+             * @return The next hop, or 0 if the node is unknown or unreachable
+             */
+            node_id get_next_hop(const node_id &destination) const {
+                return routes[destination].next_hop;
+            }
+
+            /**
+             * \brief Get the first hops of all shortest paths to a node
+             *
+             * The first hops are collected by update_backups, so this only looks them up.
+             * Since every hop on a shortest path gets strictly closer to the destination, forwarding over any of them can't loop.
+             * Only the first 32 neighbours of this node are used as extra first hops.
+             * While the graph is dirty, or edges changed since update_backups, only the next hop from the forwarding table is returned.
+             * @param destination Node to find the next hops for
+             * @param next_hops Array to store the next hops in, the next hop from the forwarding table comes first
+             * @param max_count Size of next_hops
+             * @return Amount of next hops stored, 0 if the node is unknown or unreachable
+             */
+            size_t get_next_hops(const node_id &destination, node_id next_hops[], size_t max_count) const;
+
+            /**
+             * \brief Get the length of the shortest path to a node
+             * @param destination Node to get the distance for
+             * @return The distance, or unreachable
+             */
+            uint16_t get_distance(const node_id &destination) const {
+                return routes[destination].distance;
+            }
+
+            /**
+             * \brief Find a node by its id
+             * @param id Id of the node
+             * @return The node, or nullptr if it isn't in the graph
+             */
+            const topology_node *find_node(const node_id &id) const {
+                return node_index[id] == no_node ? nullptr : &nodes[node_index[id]];
+            }
+
+            /**
+             * \brief Get the amount of nodes in the graph, including this node
+             * @return The node count
+             */
+            size_t get_node_count() const;
+
+            /**
+             * \brief Get a node by its index
+             * @param index Index of the node, lower than get_node_count(). Index 0 is this node
+             * @return The node
+             */
+            const topology_node &get_node(size_t index) const;
+
+            /**
+             * \brief Get the maximum amount of edges per node
+             * @return The edge capacity
+             */
+            size_t get_edge_capacity() const;
+        };
+
+        /**
+         * \brief Link state graph with its own fixed storage
+         *
+         * Uses max_nodes * (2 * max_edges + sizeof(topology_node)) bytes, on top of the 1.3 KB of lookup tables in link_state_topology.
+         * A topology_node is 16 bytes on 32-bit targets, and 24 bytes on 64-bit hosts. benchmark/topology_benchmark.cpp measures the size and calculation time of several pools.
+         * @tparam max_nodes Maximum amount of nodes, including this node. At most 254
+         * @tparam max_edges Maximum amount of edges per node
+         */
+        template<size_t max_nodes, size_t max_edges>
+        class topology_pool : public link_state_topology {
+            static_assert(max_nodes > 0 && max_nodes < no_node, "A topology holds 1 to 254 nodes");
+
+            std::array<topology_node, max_nodes> pool_nodes;
+            std::array<std::array<node_id, max_edges>, max_nodes> pool_edges;
+            std::array<std::array<uint8_t, max_edges>, max_nodes> pool_costs;
+
+        public:
+            topology_pool() : link_state_topology(max_nodes, max_edges), pool_nodes(), pool_edges(), pool_costs() {
+                nodes = pool_nodes.data();
+                for (size_t i = 0; i < max_nodes; i++) {
+                    pool_nodes[i].edges = pool_edges[i].data();
+                    pool_nodes[i].edge_costs = pool_costs[i].data();
+                }
+            }
+        };
+
+        /**
+         * @}
+         */
+    }
+}
+
+#endif //IPASS_MESH_LINK_STATE_TOPOLOGY_HPP
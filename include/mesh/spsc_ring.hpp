@@ -0,0 +1,173 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_MESH_SPSC_RING_HPP
+#define IPASS_MESH_SPSC_RING_HPP
+
+#include <stddef.h>
+#include <array>
+#include <atomic>
+
+namespace mesh {
+    /**
+     * \addtogroup mesh_networking
+     * @{
+     */
+
+    /**
+     * \brief What a producer does with an item that doesn't fit in a full spsc_ring
+     */
+    enum overflow_policy {
+        /// Leave the item where it came from (for example a hardware FIFO), and try again later
+        OVERFLOW_KEEP,
+        /// Discard the item
+        OVERFLOW_DROP
+    };
+
+    /**
+     * \brief Lock-free ring buffer for a single producer and a single consumer
+     *
+     * The producer and consumer can run in different contexts, for example an interrupt handler and the main loop.
+     * Items are written in place: the producer claims a slot, fills it and publishes it, the consumer reads the front slot and pops it when it's done.
+     * One slot is always kept free to tell a full ring from an empty one.
+     * This class doesn't own the slots, use spsc_ring_buffer to create a ring with storage.
+     * @tparam T Type of the items
+     */
+    template<typename T>
+    class spsc_ring {
+        size_t slot_count;
+        /// Next slot to read, only written by the consumer
+        std::atomic<size_t> head{0};
+        /// Next slot to write, only written by the producer
+        std::atomic<size_t> tail{0};
+        /// Only written by the producer
+        std::atomic<size_t> overflows{0};
+
+        size_t next(size_t index) const {
+            return index + 1 == slot_count ? 0 : index + 1;
+        }
+
+    protected:
+        /// Array of slot_count slots. Set by the class providing the storage
+        T *slots = nullptr;
+
+        /**
+         * \brief Create a ring, storage should be set by the subclass
+         * @param slot_count Amount of slots, the ring can hold one item less
+         */
+        explicit spsc_ring(size_t slot_count) : slot_count(slot_count) {}
+
+    public:
+        spsc_ring(const spsc_ring &) = delete;
+
+        spsc_ring &operator=(const spsc_ring &) = delete;
+
+        /**
+         * \brief Get the slot to write the next item in (producer only)
+         *
+         * The item is not visible to the consumer until publish is called.
+         * @return The slot, or nullptr if the ring is full
+         */
+        T *claim() {
+            size_t index = tail.load(std::memory_order_relaxed);
+            if (next(index) == head.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            return &slots[index];
+        }
+
+        /**
+         * \brief Make the slot returned by claim available to the consumer (producer only)
+         */
+        void publish() {
+            tail.store(next(tail.load(std::memory_order_relaxed)), std::memory_order_release);
+        }
+
+        /**
+         * \brief Count an item that didn't fit in the ring (producer only)
+         */
+        void record_overflow() {
+            overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        /**
+         * \brief Get the oldest item (consumer only)
+         *
+         * The slot is not reused until pop is called.
+         * @return The item, or nullptr if the ring is empty
+         */
+        T *front() {
+            size_t index = head.load(std::memory_order_relaxed);
+            if (index == tail.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            return &slots[index];
+        }
+
+        /**
+         * \brief Remove the oldest item, so its slot can be reused (consumer only)
+         */
+        void pop() {
+            size_t index = head.load(std::memory_order_relaxed);
+            if (index != tail.load(std::memory_order_acquire)) {
+                head.store(next(index), std::memory_order_release);
+            }
+        }
+
+        /**
+         * \brief Get the amount of items in the ring
+         *
+         * When called while the other side is active, the result might already be outdated.
+         * @return The amount of items
+         */
+        size_t size() const {
+            size_t start = head.load(std::memory_order_acquire);
+            size_t end = tail.load(std::memory_order_acquire);
+            return end >= start ? end - start : slot_count - start + end;
+        }
+
+        /**
+         * \brief Get the maximum amount of items in the ring
+         * @return The capacity
+         */
+        size_t capacity() const {
+            return slot_count - 1;
+        }
+
+        /**
+         * \brief Get the amount of times an item didn't fit in the ring
+         * @return The overflow count
+         */
+        size_t overflow_count() const {
+            return overflows.load(std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * \brief SPSC ring with its own fixed storage
+     *
+     * @tparam T Type of the items
+     * @tparam capacity Maximum amount of items in the ring
+     */
+    template<typename T, size_t capacity>
+    class spsc_ring_buffer : public spsc_ring<T> {
+        std::array<T, capacity + 1> storage;
+
+    public:
+        spsc_ring_buffer() : spsc_ring<T>(capacity + 1), storage() {
+            this->slots = storage.data();
+        }
+    };
+
+    /**
+     * @}
+     */
+}
+
+#endif //IPASS_MESH_SPSC_RING_HPP
@@ -0,0 +1,131 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_MESH_STORE_AND_FORWARD_HPP
+#define IPASS_MESH_STORE_AND_FORWARD_HPP
+
+#include <mesh/message.hpp>
+
+namespace mesh {
+    /**
+     * \addtogroup mesh_networking
+     * @{
+     */
+
+    /**
+     * \brief Holds messages that can't be sent yet, until a route to their receiver is found
+     *
+     * mesh_network stores a message here when the router has no next hop for it, or when it couldn't be queued for its next hop.
+     * When the router reports that routes changed, the stored messages are sent again, oldest first.
+     *
+     * Memory use is bounded: a fixed amount of messages is stored, a receiver can only use per_destination_limit of them at once,
+     * and messages that are stored for ttl ticks are dropped.
+     * This class doesn't own the storage, use store_and_forward_pool to create a store with storage.
+     */
+    class store_and_forward {
+    public:
+        /**
+         * \brief A message waiting for a route
+         */
+        struct stored_message {
+            /// Ticks since the message was stored
+            uint16_t age = 0;
+            /// The message
+            message msg;
+        };
+
+    private:
+        size_t capacity;
+        size_t count = 0;
+        uint8_t per_destination_limit;
+        uint16_t ttl;
+        /// Amount of messages that were dropped, because there was no room or they expired
+        uint16_t dropped_count = 0;
+
+    protected:
+        /// Array of capacity messages, of which the first count are in use, oldest first. Set by the class providing the storage
+        stored_message *messages = nullptr;
+
+        /**
+         * \brief Create a store, storage should be set by the subclass
+         *
+         * @param capacity Amount of messages that can be stored
+         * @param per_destination_limit Maximum amount of messages stored for a single receiver
+         * @param ttl Amount of ticks after which a stored message is dropped
+         */
+        store_and_forward(size_t capacity, uint8_t per_destination_limit, uint16_t ttl);
+
+    public:
+        /**
+         * \brief Store a copy of a message
+         * @param msg Message to store, its sender and receiver should be set
+         * @return False if the store is full, or the receiver already has per_destination_limit messages stored
+         */
+        bool store(const message &msg);
+
+        /**
+         * \brief Age all messages by one tick, dropping messages that are older than the ttl
+         */
+        void tick();
+
+        /**
+         * \brief Get the amount of stored messages
+         * @return The count
+         */
+        size_t get_count() const;
+
+        /**
+         * \brief Get a stored message by its index
+         * @param index Index of the message, lower than get_count(). Lower indices are older
+         * @return The message
+         */
+        const message &get(size_t index) const;
+
+        /**
+         * \brief Remove a stored message, for example because it was sent
+         *
+         * The messages after it move one index down.
+         * @param index Index of the message, lower than get_count()
+         */
+        void remove(size_t index);
+
+        /**
+         * \brief Get the amount of messages that were dropped, because there was no room or they expired
+         * @return The dropped count, wraps around
+         */
+        uint16_t get_dropped_count() const;
+    };
+
+    /**
+     * \brief Store and forward buffer with its own fixed storage
+     *
+     * @tparam message_count Amount of messages that can be stored
+     */
+    template<size_t message_count>
+    class store_and_forward_pool : public store_and_forward {
+        std::array<stored_message, message_count> pool_messages;
+
+    public:
+        /**
+         * \brief Create a store and forward pool
+         * @param per_destination_limit Maximum amount of messages stored for a single receiver
+         * @param ttl Amount of ticks (mesh_network::update calls) after which a stored message is dropped
+         */
+        explicit store_and_forward_pool(uint8_t per_destination_limit = 4, uint16_t ttl = 3000) :
+                store_and_forward(message_count, per_destination_limit, ttl), pool_messages() {
+            messages = pool_messages.data();
+        }
+    };
+
+    /**
+     * @}
+     */
+}
+
+#endif //IPASS_MESH_STORE_AND_FORWARD_HPP
@@ -25,10 +25,10 @@ void mesh::addons::status_lcd::update(mesh_network &network) {
             lcd.set_row(1);
             auto &router = static_cast<mesh::routers::link_state &>(network.get_router());
             router.update_neighbours();
-            router.get_calculator().cleanup(true);
-            for (uint8_t i = 1; i < router.get_calculator().get_node_count(); i++) {
-                auto node = router.get_calculator().get_node(i);
-                lcd << hwlib::hex << node.id << "(" << node.distance << ")";
+            auto &topology = router.get_topology();
+            for (size_t i = 1; i < topology.get_node_count(); i++) {
+                auto &node = topology.get_node(i);
+                lcd << hwlib::hex << node.id << "(" << topology.get_distance(node.id) << ")";
             }
             break;
         }
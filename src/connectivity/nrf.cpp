@@ -18,9 +18,22 @@ namespace mesh {
 
     namespace connectivity {
 
-        nrf::nrf(const node_id &address, nrf24l01plus &nrf)
+        nrf::spi_guard::spi_guard(nrf &owner) : owner(owner), outer(!owner.spi_busy.exchange(true)) {}
+
+        nrf::spi_guard::~spi_guard() {
+            if (!outer) {
+                return;
+            }
+            owner.spi_busy.store(false);
+            if (owner.irq_pending.load()) {
+                owner.handle_irq();
+            }
+        }
+
+        nrf::nrf(const node_id &address, nrf24l01plus &nrf, spsc_ring<nrf_frame> &receive_buffer)
                 : connectivity_adapter(
                 address),
+                  receive_buffer(receive_buffer),
                   connections{
                           nrf_pipe(0),
                           nrf_pipe(1),
@@ -29,7 +42,7 @@ namespace mesh {
                           nrf_pipe(4),
                           nrf_pipe(5)
                   },
-                  nrf24(nrf) {
+                  nrf24(nrf), registers(nrf) {
 
 
             nrf.write_register(NRF_REGISTER::FEATURE, NRF_FEATURE::EN_DPL | NRF_FEATURE::EN_DYN_ACK);
@@ -38,7 +51,7 @@ namespace mesh {
             nrf.rx_auto_acknowledgement(true);
             nrf.rx_set_dynamic_payload_length(true);
 
-            nrf.write_register(NRF_REGISTER::SETUP_RETR, 0xFA);
+            nrf.write_register(NRF_REGISTER::SETUP_RETR, 0xF0 | (max_hardware_attempts - 1));
 
             nrf.write_register(NRF_REGISTER::RF_SETUP, 0x08);
 
@@ -46,75 +59,220 @@ namespace mesh {
             connections[0].setNodeId(0);
             connections[0].setNrfAddress(discovery_address);
             connections[0].setConnectionState(mesh::ACCEPTED);
-            connections[0].flush(nrf);
+            connections[0].flush(registers);
 
             start_waiting();
 
-            nrf.mode(nrf.MODE_PRX);
+            registers.mode(nrf.MODE_PRX);
         }
 
 
-        void nrf::add_connection_data(message &message, node_id &next_hop) {
-            switch (message.type) {
+        void nrf::add_connection_data(uint8_t connection_data[], const message_type &type, node_id &next_hop) {
+            switch (type) {
                 case DISCOVERY::RESPOND:
-                    message.connectionData[0] = connections[getPipeByNodeId(next_hop)].getNrfAddress().address_bytes[4];
+                    connection_data[0] = connections[getPipeByNodeId(next_hop)].getNrfAddress().address_bytes[4];
                     break;
                 case DISCOVERY::PRESENT:
-                    message.connectionData[0] = connections[getPipeByNodeId(id)].getNrfAddress().address_bytes[4];
+                    connection_data[0] = connections[getPipeByNodeId(id)].getNrfAddress().address_bytes[4];
                     break;
                 default:
                     break;
             }
         }
 
-        bool nrf::send_implementation(node_id &id, uint8_t *data, size_t size) {
+        void nrf::set_irq_pin(hwlib::pin_in &pin) {
+            irq_pin = &pin;
+        }
+
+        void nrf::set_overflow_policy(overflow_policy policy) {
+            receive_overflow = policy;
+        }
+
+        void nrf::handle_irq() {
+            do {
+                if (spi_busy.exchange(true)) {
+                    irq_pending.store(true);
+                    return;
+                }
+                do {
+                    irq_pending.store(false);
+                    drain_rx();
+                } while (irq_pending.load());
+                spi_busy.store(false);
+                // An IRQ between the last check and releasing the bus only marked itself pending
+            } while (irq_pending.load());
+        }
+
+        bool nrf::start_transmit(node_id &id, uint8_t *data, size_t size) {
+            spi_guard guard(*this);
             size_t listen_pipe = getPipeByNodeId(id);
             if (listen_pipe == 6) {
                 LOG("No Pipe", "");
                 return false;
             }
-            return connections[listen_pipe].send_message(connections, nrf24, size, data);
+            if (transmit_pipe != 6) { // Already transmitting, append to the TX FIFO
+                if (transmit_pipe != listen_pipe || transmit_count >= max_transmit_payloads || transmit_failure) {
+                    return false;
+                }
+                connections[listen_pipe].queue_send(registers, size, data);
+                transmit_count++;
+                return true;
+            }
+            if (restore_pipe == 6) {
+                transmit_old_mode = registers.get_mode();
+            } else if (restore_pipe != listen_pipe) { // Give the previous pipe and pipe 0 their own addresses back
+                connections[restore_pipe].finish_send(connections, registers);
+            }
+            restore_pipe = listen_pipe;
+            transmit_pipe = listen_pipe;
+            transmit_start = hwlib::now_us();
+            transmit_count = 1;
+            transmit_done = 0;
+            connections[listen_pipe].start_send(registers, size, data);
+            return true;
         }
 
-        mesh::message nrf::next_message() {
-            buffer_messages();
-            if (buffer_end != buffer_start) {
-                message &msg = message_buffer[buffer_start++];
-                if (buffer_start == 100) {
-                    buffer_start = 0;
+        void nrf::end_transmit() {
+            transmit_pipe = 6;
+            transmit_count = 0;
+            transmit_done = 0;
+            transmit_failure = false;
+        }
+
+        transmit_status nrf::poll_transmit() {
+            if (transmit_pipe == 6) {
+                return TRANSMIT_FAILED;
+            }
+            spi_guard guard(*this);
+            if (transmit_done == 0 && !transmit_failure) {
+                nrf24.no_operation();
+                bool sent = (nrf24.last_status & NRF_STATUS::TX_DS) > 0;
+                bool failed = (nrf24.last_status & NRF_STATUS::MAX_RT) > 0;
+                if (sent) { // Cleared before reading the FIFO, so a payload sent in between sets it again
+                    nrf24.write_register(NRF_REGISTER::NRF_STATUS, NRF_STATUS::TX_DS);
+                }
+                bool empty = (nrf24.fifo_status() & fifo_tx_empty) != 0;
+                if (empty) { // Payloads sent since the clear are counted now, so their TX_DS is stale
+                    nrf24.write_register(NRF_REGISTER::NRF_STATUS, NRF_STATUS::TX_DS);
+                }
+                // Sent payloads left the FIFO, TX_DS means at least one did (at most max_transmit_payloads are written)
+                transmit_done = empty ? transmit_count : (sent ? uint8_t(transmit_count - 1) : uint8_t(0));
+                if (failed) { // The failed payload, and the ones after it, are flushed
+                    nrf24.write_register(NRF_REGISTER::NRF_STATUS, NRF_STATUS::MAX_RT);
+                    nrf24.tx_flush();
+                    transmit_failure = true;
+                } else if (transmit_done == 0 && hwlib::now_us() - transmit_start > transmit_timeout_us) {
+                    nrf24.tx_flush();
+                    transmit_failure = true;
+                }
+
+                if (transmit_done > 0) {
+                    transmit_start = hwlib::now_us();
+                    // ARC_CNT only covers the last sent payload, it is used for all payloads counted now
+                    uint8_t observe_tx = 0;
+                    nrf24.read_register(NRF_REGISTER::OBSERVE_TX, &observe_tx);
+                    last_attempts = uint8_t((observe_tx & 0x0F) + 1);
                 }
-                return msg;
             }
-            return {};
-        }
 
-        void nrf::buffer_messages() {
+            if (transmit_done == 0) {
+                if (!transmit_failure) {
+                    return TRANSMIT_PENDING;
+                }
+                last_attempts = max_hardware_attempts;
+                end_transmit();
+                return TRANSMIT_FAILED;
+            }
 
+            transmit_done--;
+            if (--transmit_count == 0) {
+                end_transmit();
+            }
+            return TRANSMIT_SUCCESS;
+        }
 
-            while ((nrf24.fifo_status() & uint8_t(1)) == 0) {
-                uint8_t payload_width = nrf24.rx_payload_width();
-                uint8_t data[payload_width];
-                nrf24.rx_read_payload(data, payload_width);
+        uint8_t nrf::transmit_attempts() {
+            return last_attempts;
+        }
 
+        size_t nrf::transmit_window() {
+            return max_transmit_payloads;
+        }
 
-                nrf24.write_register(NRF_REGISTER::NRF_STATUS, NRF_STATUS::RX_DR);
-                message_buffer[buffer_end++].parse(payload_width, data);
+        void nrf::transmit_idle() {
+            if (restore_pipe == 6) {
+                return;
+            }
+            spi_guard guard(*this);
+            connections[restore_pipe].finish_send(connections, registers);
+            registers.mode(transmit_old_mode);
+            restore_pipe = 6;
+        }
 
-                if (buffer_end == 100) {
-                    buffer_end = 0;
-                }
-                if (buffer_end == (buffer_start - 1)) {
-                    // The input buffer is full panic
+        mesh::message_view nrf::next_frame() {
+            buffer_messages();
+            if (frame_taken) {
+                receive_buffer.pop();
+                frame_taken = false;
+            }
+            nrf_frame *received = receive_buffer.front();
+            if (received == nullptr) {
+                return {};
+            }
+            frame_taken = true;
+            return {received->bytes.data(), received->size};
+        }
+
+        void nrf::buffer_messages() {
+            if (irq_pin != nullptr) {
+                irq_pin->refresh();
+                if (irq_pin->read()) { // IRQ is active low, the module has nothing to report
+                    return;
                 }
             }
+            spi_guard guard(*this);
+            drain_rx();
+        }
+
+        void nrf::drain_rx() {
+            while ((nrf24.fifo_status() & uint8_t(1)) == 0) {
+                nrf_frame discarded;
+                nrf_frame *received = receive_buffer.claim();
+                if (received == nullptr) {
+                    if (receive_overflow == OVERFLOW_KEEP) {
+                        if (!receive_stalled) {
+                            receive_buffer.record_overflow();
+                            receive_stalled = true;
+                        }
+                        break;
+                    }
+                    receive_buffer.record_overflow();
+                    received = &discarded;
+                } else {
+                    receive_stalled = false;
+                }
 
+                uint8_t payload_width = nrf24.rx_payload_width();
+                if (payload_width > received->bytes.size()) {
+                    // Corrupted payload width, read the payload to remove it from the FIFO, but don't buffer it
+                    nrf24.rx_read_payload(discarded.bytes.data(), discarded.bytes.size());
+                    nrf24.write_register(NRF_REGISTER::NRF_STATUS, NRF_STATUS::RX_DR);
+                    continue;
+                }
+                received->size = payload_width;
+                nrf24.rx_read_payload(received->bytes.data(), payload_width);
+                nrf24.write_register(NRF_REGISTER::NRF_STATUS, NRF_STATUS::RX_DR);
 
+                if (received != &discarded) {
+                    receive_buffer.publish();
+                }
+            }
         }
 
 
-        bool nrf::has_message() {
+        bool nrf::has_frame() {
             buffer_messages();
-            return buffer_start != buffer_end;
+            return receive_buffer.size() > (frame_taken ? 1u : 0u);
         }
 
 
@@ -124,11 +282,12 @@ namespace mesh {
                 return false;
             }
 
+            spi_guard guard(*this);
             nrf_pipe &freeConnection = connections[freePipe];
             freeConnection.setNodeId(origin.sender);
             freeConnection.setNrfAddress({base_address, origin.connectionData[0]});
             freeConnection.setConnectionState(mesh::RESPONDED);
-            freeConnection.flush(nrf24);
+            freeConnection.flush(registers);
 
             return true;
         }
@@ -139,19 +298,22 @@ namespace mesh {
                 return;
             }
 
+            spi_guard guard(*this);
             nrf_pipe &conn = connections[pipe];
             LOG("REMOVING", pipe << " - " << id);
             conn.setConnectionState(mesh::DISCONNECTED);
             conn.setNodeId(0);
             forget_message_history_for(id);
+            forget_link_quality(id);
 
-            conn.flush(nrf24);
+            conn.flush(registers);
 
             start_waiting();
         }
 
 
         void nrf::start_waiting() {
+            spi_guard guard(*this);
             // Check if there is a listen pipe already active
             for (size_t i = 1; i < 6; i++) {
                 if (connections[i].getConnectionState() == mesh::WAITING) {
@@ -177,7 +339,7 @@ namespace mesh {
                     empty_connection.setNrfAddress(listenaddress);
                     empty_connection.setNodeId(id);
                     empty_connection.setConnectionState(mesh::WAITING);
-                    empty_connection.flush(nrf24);
+                    empty_connection.flush(registers);
                     return;
                 }
             }
@@ -219,11 +381,12 @@ namespace mesh {
             }
 
 
+            spi_guard guard(*this);
             nrf_pipe &connection = connections[pipe_nr];
 
             connection.setConnectionState(mesh::ACCEPTED);
             connection.setNodeId(origin.sender);
-            connection.flush(nrf24);
+            connection.flush(registers);
 
 
             start_waiting();
@@ -270,6 +433,7 @@ namespace mesh {
                 LOG(i, connections[i]);
             }
 
+            spi_guard guard(*this);
             nrf24l01::address test = nrf24.rx_get_address(0);
             LOG("RX0", test);
             test = nrf24.tx_get_address();
@@ -15,9 +15,15 @@ using nrf24l01::NRF_REGISTER;
 
 namespace mesh {
     namespace connectivity {
-        void nrf_pipe::flush(nrf24l01plus &nrf) {
+        void nrf_pipe::flush(nrf_register_cache &nrf) {
+            bool enabled = connection_state != mesh::DISCONNECTED;
+            if (nrf.rx_matches(pipe_number, enabled, nrf_address) &&
+                (!enabled || pipe_number != 0 || nrf.tx_matches(nrf_address))) {
+                return;
+            }
+
             uint8_t old_mode = nrf.get_mode();
-            nrf.mode(nrf.MODE_NONE);
+            nrf.mode(nrf.radio().MODE_NONE);
             switch (connection_state) {
                 case mesh::DISCONNECTED:
                     nrf.rx_enabled(pipe_number, false);
@@ -35,41 +41,31 @@ namespace mesh {
             nrf.mode(old_mode);
         }
 
-        bool nrf_pipe::send_message(array<nrf_pipe, 6> &all_pipes, nrf24l01plus &nrf,
-                                    uint8_t n,
-                                    uint8_t *data) {
-            uint8_t old_mode = nrf.get_mode();
-            nrf.mode(nrf.MODE_PTX);
+        void nrf_pipe::start_send(nrf_register_cache &nrf, uint8_t n, uint8_t *data) {
+            nrf.mode(nrf.radio().MODE_PTX);
 
             uint8_t old_pipe = pipe_number;
             if (pipe_number != 0) {
                 nrf.rx_enabled(pipe_number, false);
                 pipe_number = 0;
                 flush(nrf);
+                pipe_number = old_pipe;
             }
-            nrf.tx_flush();
-            nrf.write_register(NRF_REGISTER::NRF_STATUS, 0x60); //clear previous sent bit
-            nrf.write_register(NRF_REGISTER::NRF_STATUS, 0x10); // Clear Max RT
-            nrf.tx_write_payload(data, n, old_pipe == 0);
-            bool success = true;
-            do {
-                nrf.no_operation();
-                if ((nrf.last_status & nrf24l01::NRF_STATUS::MAX_RT) > 0) {
-                    success = false;
-                    nrf.write_register(NRF_REGISTER::NRF_STATUS, 0x10); // Clear Max RT
-                    break;
-                }
-
-            } while ((nrf.last_status & nrf24l01::NRF_STATUS::TX_DS) == 0);
+            nrf24l01plus &radio = nrf.radio();
+            radio.tx_flush();
+            radio.write_register(NRF_REGISTER::NRF_STATUS, 0x70); // Clear previous sent bit and Max RT
+            radio.tx_write_payload(data, n, pipe_number == 0);
+        }
 
+        void nrf_pipe::queue_send(nrf_register_cache &nrf, uint8_t n, uint8_t *data) {
+            nrf.radio().tx_write_payload(data, n, pipe_number == 0);
+        }
 
-            if (old_pipe != 0) {
-                pipe_number = old_pipe;
+        void nrf_pipe::finish_send(array<nrf_pipe, 6> &all_pipes, nrf_register_cache &nrf) {
+            if (pipe_number != 0) {
                 flush(nrf);
                 all_pipes[0].flush(nrf);
             }
-            nrf.mode(old_mode);
-            return success;
         }
 
         void nrf_pipe::setConnectionState(mesh::mesh_connection_state cS) {
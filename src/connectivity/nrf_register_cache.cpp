@@ -0,0 +1,100 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include <mesh/connectivity/nrf_register_cache.hpp>
+
+using nrf24l01::nrf24l01plus;
+
+namespace mesh {
+    namespace connectivity {
+        nrf_register_cache::nrf_register_cache(nrf24l01plus &nrf) : nrf(nrf) {}
+
+        bool nrf_register_cache::same_address(const nrf24l01::address &a, const nrf24l01::address &b) {
+            for (size_t i = 0; i < 5; i++) {
+                if (a.address_bytes[i] != b.address_bytes[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        nrf24l01plus &nrf_register_cache::radio() {
+            return nrf;
+        }
+
+        void nrf_register_cache::mode(uint8_t mode) {
+            if (mode_known && current_mode == mode) {
+                return;
+            }
+            nrf.mode(mode);
+            current_mode = mode;
+            mode_known = true;
+        }
+
+        uint8_t nrf_register_cache::get_mode() {
+            if (!mode_known) {
+                current_mode = nrf.get_mode();
+                mode_known = true;
+            }
+            return current_mode;
+        }
+
+        void nrf_register_cache::rx_enabled(uint8_t pipe, bool enabled) {
+            uint8_t bit = uint8_t(1 << pipe);
+            if ((enabled_known & bit) != 0 && ((enabled_pipes & bit) != 0) == enabled) {
+                return;
+            }
+            nrf.rx_enabled(pipe, enabled);
+            enabled_known |= bit;
+            if (enabled) {
+                enabled_pipes |= bit;
+            } else {
+                enabled_pipes &= uint8_t(~bit);
+            }
+        }
+
+        void nrf_register_cache::rx_set_address(uint8_t pipe, const nrf24l01::address &address) {
+            uint8_t bit = uint8_t(1 << pipe);
+            if ((rx_address_known & bit) != 0 && same_address(rx_addresses[pipe], address)) {
+                return;
+            }
+            nrf.rx_set_address(pipe, address);
+            rx_addresses[pipe] = address;
+            rx_address_known |= bit;
+        }
+
+        void nrf_register_cache::tx_set_address(const nrf24l01::address &address) {
+            if (tx_address_known && same_address(tx_address, address)) {
+                return;
+            }
+            nrf.tx_set_address(address);
+            tx_address = address;
+            tx_address_known = true;
+        }
+
+        bool nrf_register_cache::rx_matches(uint8_t pipe, bool enabled, const nrf24l01::address &address) const {
+            uint8_t bit = uint8_t(1 << pipe);
+            if ((enabled_known & bit) == 0 || ((enabled_pipes & bit) != 0) != enabled) {
+                return false;
+            }
+            return !enabled || ((rx_address_known & bit) != 0 && same_address(rx_addresses[pipe], address));
+        }
+
+        bool nrf_register_cache::tx_matches(const nrf24l01::address &address) const {
+            return tx_address_known && same_address(tx_address, address);
+        }
+
+        void nrf_register_cache::invalidate() {
+            mode_known = false;
+            enabled_known = 0;
+            rx_address_known = 0;
+            tx_address_known = false;
+        }
+    }
+}
@@ -8,7 +8,6 @@
 */
 
 #include <mesh/connectivity_adapter.hpp>
-#include <cout_debug.hpp>
 
 void mesh::connectivity_adapter::add_message_id(mesh::message &msg) {
     if (msg.sender == id && msg.message_id == 0) {
@@ -18,91 +17,577 @@ void mesh::connectivity_adapter::add_message_id(mesh::message &msg) {
 
 mesh::connectivity_adapter::connectivity_adapter(const mesh::node_id &my_id) : id(my_id) {}
 
-void mesh::connectivity_adapter::forget_message_history_for(const mesh::node_id &id) {
-    for (size_t i = 0; i < previous_messages_count; i++) {
-        if ((previous_messages[i] >> 8) == id) {
-            for (uint8_t j = i; j < previous_messages_count; j++) {
-                previous_messages[i] = previous_messages[i + 1];
-            }
-            previous_messages_count--;
+size_t mesh::connectivity_adapter::find_node(const mesh::node_id &id) const {
+    for (size_t i = 0; i < max_nodes; i++) {
+        if (nodes[i].id == id) {
+            return i;
         }
     }
+    return max_nodes;
 }
 
-bool mesh::connectivity_adapter::is_new_message(const mesh::message &msg) {
-    uint16_t check_value = ((msg.sender << 8) | msg.message_id);
-    for (size_t i = 0; i < previous_messages_count; i++) {
-        if (previous_messages[i] == check_value) {
-            return false;
+mesh::connectivity_adapter::node_state &mesh::connectivity_adapter::use_node(const mesh::node_id &id) {
+    size_t index = find_node(id);
+    if (index == max_nodes) {
+        index = 0;
+        for (size_t i = 0; i < max_nodes; i++) {
+            if (nodes[i].id == 0) {
+                index = i;
+                break;
+            }
+            if (uint16_t(node_clock - nodes[i].last_used) > uint16_t(node_clock - nodes[index].last_used)) {
+                index = i;
+            }
         }
+        nodes[index] = {};
+        nodes[index].id = id;
+    }
+    nodes[index].last_used = node_clock++;
+    return nodes[index];
+}
+
+void mesh::connectivity_adapter::forget_message_history_for(const mesh::node_id &id) {
+    size_t index = find_node(id);
+    if (index < max_nodes) {
+        nodes[index].received_window = 0;
     }
+}
 
-    if (previous_messages_count == 20) {
-        for (uint8_t i = 0; i < 19; i++) {
-            previous_messages[i] = previous_messages[i + 1];
-        }
-        previous_messages_count--;
+void mesh::connectivity_adapter::set_duplicate_window(uint8_t size) {
+    if (size < 1) {
+        size = 1;
+    } else if (size > 32) {
+        size = 32;
+    }
+    duplicate_window = size;
+}
+
+bool mesh::connectivity_adapter::is_new_message(const mesh::message_view &msg) {
+    node_state &sender = use_node(msg.sender());
+    uint32_t &window = sender.received_window;
+    uint8_t &last_id = sender.last_message_id;
+    uint32_t window_mask = duplicate_window == 32 ? 0xFFFFFFFF : (uint32_t(1) << duplicate_window) - 1;
+
+    uint8_t ahead = uint8_t(msg.message_id() - last_id);
+    uint8_t behind = uint8_t(last_id - msg.message_id());
+
+    if (window == 0 || (ahead >= 128 && behind >= duplicate_window)) { // First message, or sender restarted
+        window = 1;
+        last_id = msg.message_id();
+        return true;
+    }
+
+    if (ahead == 0) {
+        return false;
+    }
+
+    if (ahead < 128) { // Newer message, slide the window
+        window = ahead >= 32 ? 1 : ((window << ahead) | 1) & window_mask;
+        last_id = msg.message_id();
+        return true;
+    }
+
+    uint32_t bit = uint32_t(1) << behind;
+    if ((window & bit) != 0) {
+        return false;
     }
-    previous_messages[previous_messages_count++] = check_value;
+    window |= bit;
     return true;
 }
 
-bool mesh::connectivity_adapter::send(mesh::message &message, mesh::node_id next_hop) {
-    if (next_hop == 0) next_hop = message.receiver;
+void mesh::connectivity_adapter::record_link_sample(const mesh::node_id &next_hop, uint8_t attempts, bool success) {
+    link_estimate &estimate = use_node(next_hop).link;
+    // Moving averages with a weight of 1/8 for the new sample
+    estimate.attempts = uint16_t(estimate.attempts - estimate.attempts / 8 + attempts * 32);
+    estimate.delivered = uint16_t(estimate.delivered - estimate.delivered / 8 + (success ? 32 : 0));
+}
+
+uint8_t mesh::connectivity_adapter::link_cost(const mesh::node_id &neighbour) const {
+    size_t index = find_node(neighbour);
+    if (index == max_nodes) { // No transmissions yet
+        return link_cost_unit;
+    }
+    const link_estimate &estimate = nodes[index].link;
+    if (estimate.delivered == 0) {
+        return 255;
+    }
+    uint32_t cost = uint32_t(estimate.attempts) * link_cost_unit / estimate.delivered;
+    if (cost < link_cost_unit) {
+        return link_cost_unit;
+    }
+    return cost > 255 ? uint8_t(255) : uint8_t(cost);
+}
 
+void mesh::connectivity_adapter::forget_link_quality(const mesh::node_id &neighbour) {
+    size_t index = find_node(neighbour);
+    if (index < max_nodes) {
+        nodes[index].link = {};
+    }
+}
 
+bool mesh::connectivity_adapter::can_send(const mesh::message_type &type, const mesh::node_id &receiver,
+                                          mesh::node_id next_hop) {
     mesh_connection_state state = connection_state(next_hop);
     if (state == DISCONNECTED) {
         return false;
-    } else if (message.receiver != 0 &&
+    } else if (receiver != 0 &&
                state != mesh::ACCEPTED
-               && message.type != DISCOVERY::RESPOND
-               && message.type != DISCOVERY::ACCEPT
-               && message.type != DISCOVERY::DENY) {
+               && type != DISCOVERY::RESPOND
+               && type != DISCOVERY::ACCEPT
+               && type != DISCOVERY::DENY) {
         return false;
     }
+    return true;
+}
 
-    add_message_id(message);
-    add_connection_data(message, next_hop);
+bool mesh::connectivity_adapter::enqueue(const mesh::message_type &type, mesh::traffic_class priority,
+                                         const mesh::node_id *next_hops, size_t hop_count, const uint8_t *data,
+                                         size_t size, bool patch_connection_data, bool alternatives) {
+    for (size_t i = 0; i < class_queue_size; i++) {
+        transmit_entry &entry = transmit_queue[priority * class_queue_size + i];
+        if (!entry.in_use) {
+            entry.in_use = true;
+            entry.hop_count = uint8_t(hop_count);
+            for (size_t i = 0; i < hop_count; i++) {
+                entry.next_hops[i] = next_hops[i];
+            }
+            entry.patch_connection_data = patch_connection_data;
+            entry.alternatives = alternatives;
+            entry.type = type;
+            entry.priority = priority;
+            entry.attempts = 0;
+            entry.wait = 0;
+            entry.sequence = next_sequence++;
+            entry.size = size;
+            for (size_t i = 0; i < size; i++) {
+                entry.bytes[i] = data[i];
+            }
+            poll();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool mesh::connectivity_adapter::has_next_hop(const mesh::connectivity_adapter::transmit_entry &entry,
+                                              const mesh::node_id &next_hop) {
+    size_t count = entry.alternatives ? 1 : entry.hop_count;
+    for (size_t i = 0; i < count; i++) {
+        if (entry.next_hops[i] == next_hop) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void mesh::connectivity_adapter::remove_next_hop(mesh::connectivity_adapter::transmit_entry &entry, size_t index) {
+    for (size_t i = index; i + 1 < entry.hop_count; i++) {
+        entry.next_hops[i] = entry.next_hops[i + 1];
+    }
+    entry.hop_count--;
+    if (index == 0) { // Attempts are counted per next hop
+        entry.attempts = 0;
+        entry.wait = 0;
+    }
+    if (entry.hop_count == 0) {
+        entry.in_use = false;
+    }
+}
+
+mesh::connectivity_adapter::transmit_entry *mesh::connectivity_adapter::next_transmission() {
+    transmit_entry *next = nullptr;
+    for (transmit_entry &entry : transmit_queue) {
+        if (!entry.in_use || entry.in_flight ||
+            (in_flight_count > 0 && entry.next_hops[0] != in_flight[0]->next_hops[0])) {
+            continue;
+        }
+        if (next != nullptr && entry.priority > next->priority) {
+            continue;
+        }
+        node_id next_hop = entry.next_hops[0];
+        bool is_first = true;
+        for (transmit_entry &other : transmit_queue) {
+            if (other.in_use && other.priority == entry.priority && int16_t(other.sequence - entry.sequence) < 0 &&
+                has_next_hop(other, next_hop) && !(other.in_flight && other.next_hops[0] == next_hop)) {
+                is_first = false;
+                break;
+            }
+        }
+        if (is_first && entry.wait == 0 &&
+            (next == nullptr || entry.priority < next->priority || int16_t(entry.sequence - next->sequence) < 0)) {
+            next = &entry;
+        }
+    }
+    return next;
+}
+
+void mesh::connectivity_adapter::transmit_failed(mesh::connectivity_adapter::transmit_entry &entry) {
+    if (++entry.attempts < max_transmit_attempts) {
+        entry.wait = entry.attempts;
+        return;
+    }
+
+    node_id next_hop = entry.next_hops[0];
+    message_type dropped[transmit_queue_size + coalesce_buffer_count];
+    size_t dropped_count = 0;
+    if (next_hop != 0) { // The next hop is unreachable, drop everything else for it too
+        for (transmit_entry &other : transmit_queue) {
+            if (&other == &entry || !other.in_use) {
+                continue;
+            }
+            for (size_t i = 0; i < other.hop_count; i++) {
+                if (other.next_hops[i] == next_hop) {
+                    if (!other.alternatives || i == 0) { // Losing a backup hop doesn't drop the message
+                        dropped[dropped_count++] = other.type;
+                    }
+                    remove_next_hop(other, i);
+                    break;
+                }
+            }
+        }
+        for (coalesce_buffer &buffer : coalesce_buffers) {
+            if (buffer.bundle.dataSize > 0 && buffer.bundle.receiver == next_hop) {
+                dropped[dropped_count++] = TRANSPORT::BUNDLE;
+                buffer.bundle.dataSize = 0;
+            }
+        }
+    }
+    finish_transmission(entry, false);
+    if (listener != nullptr) {
+        for (size_t i = 0; i < dropped_count; i++) {
+            listener->on_transmit_complete(next_hop, dropped[i], false);
+        }
+    }
+}
+
+void mesh::connectivity_adapter::finish_transmission(mesh::connectivity_adapter::transmit_entry &entry,
+                                                     bool success) {
+    node_id next_hop = entry.next_hops[0];
+    message_type type = entry.type;
+    if (success && entry.alternatives) { // The backups aren't needed anymore
+        entry.hop_count = 1;
+    }
+    remove_next_hop(entry, 0);
+    if (listener != nullptr) {
+        listener->on_transmit_complete(next_hop, type, success);
+    }
+}
+
+void mesh::connectivity_adapter::set_transmit_listener(mesh::transmit_listener &transmitListener) {
+    listener = &transmitListener;
+}
+
+void mesh::connectivity_adapter::poll() {
+    if (polling) {
+        return;
+    }
+    polling = true;
+
+    if (in_flight_count == 0) { // Before handling failures, so a retry waits at least one poll
+        for (transmit_entry &entry : transmit_queue) {
+            if (entry.in_use && entry.wait > 0) {
+                entry.wait--;
+            }
+        }
+    }
+
+    while (in_flight_count > 0) {
+        transmit_status status = poll_transmit();
+        if (status == TRANSMIT_PENDING) {
+            break;
+        }
+        transmit_entry &entry = *in_flight[0];
+        for (size_t i = 1; i < in_flight_count; i++) {
+            in_flight[i - 1] = in_flight[i];
+        }
+        in_flight_count--;
+        entry.in_flight = false;
+        if (entry.next_hops[0] != 0) {
+            record_link_sample(entry.next_hops[0], transmit_attempts(), status == TRANSMIT_SUCCESS);
+        }
 
+        if (status == TRANSMIT_SUCCESS) {
+            finish_transmission(entry, true);
+        } else {
+            // Transmissions after the failed one were cancelled, they are started again without counting an attempt
+            for (size_t i = 0; i < in_flight_count; i++) {
+                in_flight[i]->in_flight = false;
+            }
+            in_flight_count = 0;
+            transmit_failed(entry);
+            break;
+        }
+    }
+
+    size_t window = transmit_window();
+    if (window > max_transmit_window) {
+        window = max_transmit_window;
+    }
+    while (in_flight_count < window) {
+        transmit_entry *next = next_transmission();
+        if (next == nullptr) {
+            break;
+        }
+        if (next->patch_connection_data) {
+            add_connection_data(next->bytes.data() + next->size - message::connection_data_size, next->type,
+                                next->next_hops[0]);
+        }
+        if (!start_transmit(next->next_hops[0], next->bytes.data(), next->size)) {
+            if (in_flight_count == 0) {
+                transmit_failed(*next);
+            }
+            break;
+        }
+        next->in_flight = true;
+        in_flight[in_flight_count++] = next;
+    }
+
+    if (in_flight_count == 0) {
+        transmit_idle();
+    }
+
+    polling = false;
+}
+
+bool mesh::connectivity_adapter::is_transmitting() {
+    for (transmit_entry &entry : transmit_queue) {
+        if (entry.in_use) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t mesh::connectivity_adapter::get_queued_count(mesh::traffic_class priority) {
+    size_t count = 0;
+    for (size_t i = 0; i < class_queue_size; i++) {
+        if (transmit_queue[priority * class_queue_size + i].in_use) {
+            count++;
+        }
+    }
+    return count;
+}
+
+bool mesh::connectivity_adapter::select_hops(const mesh::message_type &type, const mesh::node_id &receiver,
+                                             mesh::node_id &next_hop, mesh::node_id &backup_hop) {
+    if (backup_hop == next_hop || (backup_hop != 0 && !can_send(type, receiver, backup_hop))) {
+        backup_hop = 0;
+    }
+    if (can_send(type, receiver, next_hop)) {
+        return true;
+    }
+    if (backup_hop == 0) {
+        return false;
+    }
+    next_hop = backup_hop;
+    backup_hop = 0;
+    return true;
+}
+
+bool mesh::connectivity_adapter::send(mesh::message &message, mesh::node_id next_hop, mesh::node_id backup_hop) {
+    if (next_hop == 0) next_hop = message.receiver;
+
+    if (!select_hops(message.type, message.receiver, next_hop, backup_hop)) {
+        return false;
+    }
+
+    add_message_id(message);
 
     uint8_t message_bytes[message.size()];
     message.to_byte_array(message_bytes);
+    if (backup_hop != 0) {
+        node_id hops[2] = {next_hop, backup_hop};
+        return enqueue(message.type, get_traffic_class(message.type), hops, 2, message_bytes, message.size(), true, true);
+    }
+    add_connection_data(message_bytes + message.size() - message::connection_data_size, message.type, next_hop);
+
+    return send_or_coalesce(message.type, next_hop, message_bytes, message.size());
+}
 
-    for (uint8_t fail_count = 0; fail_count < 5; fail_count++) {
+bool mesh::connectivity_adapter::send(const mesh::message_view &msg, mesh::node_id next_hop,
+                                      mesh::node_id backup_hop) {
+    if (next_hop == 0) next_hop = msg.receiver();
 
-        if (send_implementation(next_hop, message_bytes, message.size())) {
+    if (!select_hops(msg.type(), msg.receiver(), next_hop, backup_hop)) {
+        return false;
+    }
+
+    if (backup_hop != 0) {
+        node_id hops[2] = {next_hop, backup_hop};
+        return enqueue(msg.type(), get_traffic_class(msg.type()), hops, 2, msg.begin(), msg.size(), true, true);
+    }
+    return send_or_coalesce(msg.type(), next_hop, msg.begin(), msg.size());
+}
+
+bool mesh::connectivity_adapter::send_or_coalesce(const mesh::message_type &type, mesh::node_id &next_hop,
+                                                  uint8_t *data, size_t size) {
+    traffic_class priority = get_traffic_class(type);
+    if (coalesce_threshold == 0 || size > coalesce_threshold || size + 1 > message::payload_size ||
+        next_hop == 0 || connection_state(next_hop) != ACCEPTED ||
+        (type > DISCOVERY::NO_OPERATION && type <= DISCOVERY::DENY)) {
+        return enqueue(type, priority, &next_hop, 1, data, size);
+    }
+
+    coalesce_buffer *buffer = nullptr;
+    for (coalesce_buffer &check_buffer : coalesce_buffers) {
+        if (check_buffer.bundle.dataSize > 0 && check_buffer.bundle.receiver == next_hop &&
+            check_buffer.priority == priority) {
+            buffer = &check_buffer;
+            break;
+        }
+    }
 
+    if (buffer != nullptr && buffer->bundle.dataSize + size + 1 > message::payload_size) {
+        if (!flush_buffer(*buffer)) {
+            return false;
+        }
+    }
+
+    if (buffer == nullptr) {
+        for (coalesce_buffer &check_buffer : coalesce_buffers) {
+            if (check_buffer.bundle.dataSize == 0) {
+                buffer = &check_buffer;
+                break;
+            }
+        }
+        if (buffer == nullptr) { // No buffer free for another next hop
+            return enqueue(type, priority, &next_hop, 1, data, size);
+        }
+    }
+
+    message &bundle = buffer->bundle;
+    if (bundle.dataSize == 0) {
+        bundle = {TRANSPORT::BUNDLE, 0, id, next_hop};
+        buffer->priority = priority;
+        buffer->age = 0;
+    }
+    bundle.data[bundle.dataSize++] = uint8_t(size);
+    for (size_t i = 0; i < size; i++) {
+        bundle.data[bundle.dataSize++] = data[i];
+    }
+    return true;
+}
+
+bool mesh::connectivity_adapter::flush_buffer(mesh::connectivity_adapter::coalesce_buffer &buffer) {
+    message &bundle = buffer.bundle;
+    bool success;
+    if (bundle.data[0] + size_t(1) == bundle.dataSize) { // Only a single message, send it as-is
+        success = enqueue(bundle.data[1], buffer.priority, &bundle.receiver, 1, bundle.data.data() + 1,
+                          bundle.data[0]);
+    } else {
+        uint8_t bundle_bytes[bundle.size()];
+        bundle.to_byte_array(bundle_bytes);
+        success = enqueue(bundle.type, buffer.priority, &bundle.receiver, 1, bundle_bytes, bundle.size());
+    }
+    if (success) {
+        bundle.dataSize = 0;
+    }
+    return success;
+}
+
+mesh::traffic_class mesh::connectivity_adapter::get_traffic_class(const mesh::message_type &type) const {
+    for (size_t i = 0; i < class_override_count; i++) {
+        if (class_overrides[i].type == type) {
+            return class_overrides[i].priority;
+        }
+    }
+    if (type < 0x10) {
+        return CLASS_DISCOVERY;
+    }
+    if (type < 0x20) {
+        return CLASS_ROUTING;
+    }
+    return CLASS_DATA;
+}
+
+bool mesh::connectivity_adapter::set_traffic_class(const mesh::message_type &type, mesh::traffic_class priority) {
+    for (size_t i = 0; i < class_override_count; i++) {
+        if (class_overrides[i].type == type) {
+            class_overrides[i].priority = priority;
             return true;
         }
+    }
+    if (class_override_count == max_class_overrides) {
+        return false;
+    }
+    class_overrides[class_override_count++] = {type, priority};
+    return true;
+}
 
-        hwlib::wait_ms(1);
-        has_message();
+void mesh::connectivity_adapter::enable_coalescing(size_t threshold, uint16_t deadline) {
+    coalesce_threshold = threshold;
+    coalesce_deadline = deadline;
+}
 
+void mesh::connectivity_adapter::flush_coalesced(bool force) {
+    for (coalesce_buffer &buffer : coalesce_buffers) {
+        if (buffer.bundle.dataSize == 0) {
+            continue;
+        }
+        if (force || ++buffer.age >= coalesce_deadline) {
+            flush_buffer(buffer);
+        }
     }
+}
 
-    return false;
+bool mesh::connectivity_adapter::has_message() {
+    return bundle_remaining > 0 || has_frame();
+}
+
+mesh::message_view mesh::connectivity_adapter::next_message() {
+    if (bundle_remaining == 0) {
+        message_view frame = next_frame();
+        if (!frame.is_valid() || frame.type() != TRANSPORT::BUNDLE) {
+            return frame;
+        }
+        bundle_cursor = frame.begin() + message::header_size;
+        bundle_remaining = frame.data_size();
+        if (bundle_remaining > frame.size() - message::header_size - message::connection_data_size) {
+            bundle_remaining = 0;
+            return {};
+        }
+    }
+
+    size_t size = *bundle_cursor;
+    if (size == 0 || size + 1 > bundle_remaining) { // Malformed bundle, drop the rest of it
+        bundle_remaining = 0;
+        return {};
+    }
+    message_view msg(bundle_cursor + 1, size);
+    bundle_cursor += size + 1;
+    bundle_remaining -= size + 1;
+    return msg;
 }
 
 bool mesh::connectivity_adapter::send_all(message &msg, mesh::node_id *failed_addresses) {
-    bool all_successful = true;
-    node_id neighbours[get_neighbour_count()];
+    size_t neighbour_count = get_neighbour_count();
+    node_id neighbours[neighbour_count];
     get_neighbours(neighbours);
 
     add_message_id(msg);
+    uint8_t message_bytes[msg.size()];
+    msg.to_byte_array(message_bytes);
 
-    for (size_t i = 0; i < get_neighbour_count(); i++) {
-        if (connection_state(neighbours[i]) == mesh::ACCEPTED && msg.sender != neighbours[i]) {
-            message copy_msg = msg; //Make a copy with neighbour-specific changes
-            if (!send(copy_msg, neighbours[i])) {
+    bool all_successful = true;
+    node_id group[multicast_group_size];
+    size_t group_size = 0;
+    for (size_t i = 0; i <= neighbour_count; i++) {
+        if (i < neighbour_count && neighbours[i] != msg.sender) {
+            group[group_size++] = neighbours[i];
+        }
+        if (group_size == 0 || (group_size < multicast_group_size && i < neighbour_count)) {
+            continue;
+        }
+
+        if (!enqueue(msg.type, get_traffic_class(msg.type), group, group_size, message_bytes, msg.size(), true)) {
+            for (size_t j = 0; j < group_size; j++) {
                 if (failed_addresses != nullptr) {
-                    *failed_addresses++ = neighbours[i];
+                    *failed_addresses++ = group[j];
                 }
-                all_successful = false;
             }
-
+            all_successful = false;
         }
-
+        group_size = 0;
     }
     return all_successful;
-};
+}
@@ -0,0 +1,141 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include <mesh/fragment_reassembly.hpp>
+
+mesh::fragment_reassembly::fragment_reassembly(size_t buffer_count, size_t buffer_size,
+                                               uint8_t per_sender_limit, uint16_t timeout)
+        : buffer_count(buffer_count), buffer_size(buffer_size),
+          per_sender_limit(per_sender_limit), timeout(timeout) {}
+
+mesh::fragment_reassembly::reassembly_buffer *
+mesh::fragment_reassembly::find(const mesh::node_id &sender, const uint8_t &transfer_id) {
+    for (size_t i = 0; i < buffer_count; i++) {
+        if (buffers[i].in_use && buffers[i].sender == sender && buffers[i].transfer_id == transfer_id) {
+            return &buffers[i];
+        }
+    }
+    return nullptr;
+}
+
+mesh::fragment_reassembly::reassembly_buffer *mesh::fragment_reassembly::claim(const mesh::node_id &sender) {
+    reassembly_buffer *free_buffer = nullptr;
+    uint8_t sender_count = 0;
+    for (size_t i = 0; i < buffer_count; i++) {
+        if (!buffers[i].in_use) {
+            if (free_buffer == nullptr) {
+                free_buffer = &buffers[i];
+            }
+        } else if (buffers[i].sender == sender) {
+            sender_count++;
+        }
+    }
+    if (sender_count >= per_sender_limit) {
+        return nullptr;
+    }
+    return free_buffer;
+}
+
+void mesh::fragment_reassembly::fill_fragment(mesh::message &msg, const mesh::message_type &type,
+                                              const uint8_t &transfer_id, const uint8_t &index,
+                                              const uint8_t *data, size_t size) {
+    size_t offset = index * fragment_data_size;
+    size_t length = size - offset < fragment_data_size ? size - offset : fragment_data_size;
+
+    msg.type = TRANSPORT::FRAGMENT;
+    msg.data[0] = type;
+    msg.data[1] = transfer_id;
+    msg.data[2] = index;
+    msg.data[3] = uint8_t(fragment_count(size));
+    for (size_t i = 0; i < length; i++) {
+        msg.data[header_size + i] = data[offset + i];
+    }
+    msg.dataSize = message::size_type(header_size + length);
+}
+
+bool mesh::fragment_reassembly::add_fragment(const mesh::message &msg) {
+    if (msg.dataSize < header_size) {
+        return false;
+    }
+    uint8_t transfer_id = msg.data[1];
+    uint8_t index = msg.data[2];
+    uint8_t count = msg.data[3];
+    size_t length = msg.dataSize - header_size;
+    size_t offset = index * fragment_data_size;
+
+    if (count == 0 || index >= count || offset + length > buffer_size) {
+        return false;
+    }
+    if (index != count - 1 && length != fragment_data_size) {
+        return false;
+    }
+
+    reassembly_buffer *buffer = find(msg.sender, transfer_id);
+    if (buffer == nullptr) {
+        buffer = claim(msg.sender);
+        if (buffer == nullptr) {
+            return false;
+        }
+        buffer->in_use = true;
+        buffer->complete = false;
+        buffer->sender = msg.sender;
+        buffer->transfer_id = transfer_id;
+        buffer->type = msg.data[0];
+        buffer->fragment_count = count;
+        buffer->received_count = 0;
+        buffer->received.fill(0);
+        buffer->size = 0;
+    } else if (buffer->fragment_count != count) {
+        return false;
+    }
+
+    buffer->age = 0;
+    uint8_t mask = uint8_t(1 << (index % 8));
+    if (buffer->complete || (buffer->received[index / 8] & mask) != 0) { // Duplicate fragment
+        return true;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        buffer->data[offset + i] = msg.data[header_size + i];
+    }
+    buffer->received[index / 8] |= mask;
+    buffer->received_count++;
+    if (index == count - 1) {
+        buffer->size = offset + length;
+    }
+    if (buffer->received_count == buffer->fragment_count) {
+        buffer->complete = true;
+    }
+    return true;
+}
+
+void mesh::fragment_reassembly::tick() {
+    for (size_t i = 0; i < buffer_count; i++) {
+        if (buffers[i].in_use && ++buffers[i].age >= timeout) {
+            buffers[i].in_use = false;
+        }
+    }
+}
+
+const mesh::fragment_reassembly::reassembly_buffer *mesh::fragment_reassembly::next_completed() {
+    for (size_t i = 0; i < buffer_count; i++) {
+        if (buffers[i].in_use && buffers[i].complete) {
+            return &buffers[i];
+        }
+    }
+    return nullptr;
+}
+
+void mesh::fragment_reassembly::release(const mesh::fragment_reassembly::reassembly_buffer *buffer) {
+    for (size_t i = 0; i < buffer_count; i++) {
+        if (&buffers[i] == buffer) {
+            buffers[i].in_use = false;
+        }
+    }
+}
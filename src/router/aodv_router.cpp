@@ -0,0 +1,378 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include <mesh/router/aodv_router.hpp>
+
+namespace mesh {
+    namespace routers {
+        aodv::aodv(connectivity_adapter &connectivity, size_t route_count, size_t buffer_count) :
+                router(connectivity), route_count(route_count), buffer_count(buffer_count) {}
+
+        aodv::route_entry *aodv::find(const node_id &destination) {
+            for (size_t i = 0; i < route_count; i++) {
+                if (routes[i].destination == destination) {
+                    return &routes[i];
+                }
+            }
+            return nullptr;
+        }
+
+        aodv::route_entry *aodv::find_valid(const node_id &destination) {
+            route_entry *route = find(destination);
+            return route != nullptr && route->valid ? route : nullptr;
+        }
+
+        void aodv::update_route(const node_id &destination, const node_id &next_hop, uint8_t hop_count,
+                                uint8_t route_sequence, bool sequence_known) {
+            if (destination == 0 || destination == connectivity.id) {
+                return;
+            }
+            route_entry *route = find(destination);
+            if (route != nullptr) {
+                int8_t newer = sequence_known && route->sequence_known ? int8_t(route_sequence - route->sequence) : 0;
+                if (route->valid) {
+                    if (newer < 0 || (newer == 0 && hop_count >= route->hop_count)) {
+                        return;
+                    }
+                } else if (route->sequence_known && (sequence_known ? newer < 0 : next_hop != destination)) {
+                    // Don't bring back a route that broke, unless the destination itself is the next hop
+                    return;
+                }
+            } else {
+                // Use an unused entry, an invalid entry without a pending error, or the route closest to expiring
+                for (size_t i = 0; i < route_count; i++) {
+                    route_entry &candidate = routes[i];
+                    if (candidate.destination == 0 || (!candidate.valid && !candidate.broken)) {
+                        route = &candidate;
+                        break;
+                    }
+                    if (candidate.valid && (route == nullptr || candidate.lifetime < route->lifetime)) {
+                        route = &candidate;
+                    }
+                }
+                if (route == nullptr) {
+                    return;
+                }
+                *route = {};
+                route->destination = destination;
+            }
+
+            route->next_hop = next_hop;
+            route->hop_count = hop_count;
+            if (sequence_known) {
+                route->sequence = route_sequence;
+                route->sequence_known = true;
+            }
+            route->valid = true;
+            route->broken = false;
+            route->lifetime = active_route_timeout;
+
+            for (discovery &search : discoveries) {
+                if (search.destination == destination) {
+                    search = {};
+                }
+            }
+            flush_buffer();
+            routes_changed();
+        }
+
+        bool aodv::remember_request(const node_id &originator, uint8_t id) {
+            seen_request *slot = &seen_requests[0];
+            for (seen_request &seen : seen_requests) {
+                if (seen.originator == originator && seen.request_id == id) {
+                    return false;
+                }
+                if (slot->originator != 0 && (seen.originator == 0 || seen.age > slot->age)) {
+                    slot = &seen;
+                }
+            }
+            slot->originator = originator;
+            slot->request_id = id;
+            slot->age = 0;
+            return true;
+        }
+
+        bool aodv::start_discovery(const node_id &destination) {
+            if (destination == 0 || destination == connectivity.id) {
+                return false;
+            }
+            discovery *free = nullptr;
+            for (discovery &search : discoveries) {
+                if (search.destination == destination) {
+                    return true;
+                }
+                if (free == nullptr && search.destination == 0) {
+                    free = &search;
+                }
+            }
+            if (free == nullptr) {
+                return false;
+            }
+            free->destination = destination;
+            free->attempts = 0;
+            send_request(*free);
+            return true;
+        }
+
+        void aodv::send_request(discovery &search) {
+            sequence++;
+            request_id++;
+            search.wait = uint16_t(discovery_timeout << search.attempts);
+            search.attempts++;
+            remember_request(connectivity.id, request_id);
+
+            route_entry *known = find(search.destination);
+            message request(AODV_ROUTING::ROUTE_REQUEST, 0, connectivity.id, 0);
+            request.data[0] = connectivity.id;
+            request.data[1] = sequence;
+            request.data[2] = request_id;
+            request.data[3] = search.destination;
+            request.data[4] = known != nullptr ? known->sequence : 0;
+            request.data[5] = 0;
+            request.data[6] = known != nullptr && known->sequence_known ? 0 : UNKNOWN_SEQUENCE;
+            request.dataSize = 7;
+            connectivity.send_all(request);
+        }
+
+        void aodv::send_reply(const node_id &originator, const node_id &destination, uint8_t route_sequence,
+                              uint8_t hop_count) {
+            route_entry *reverse = find_valid(originator);
+            if (reverse == nullptr) {
+                return;
+            }
+            reverse->lifetime = active_route_timeout;
+            message reply(AODV_ROUTING::ROUTE_REPLY, 0, connectivity.id, reverse->next_hop);
+            reply.data[0] = originator;
+            reply.data[1] = destination;
+            reply.data[2] = route_sequence;
+            reply.data[3] = hop_count;
+            reply.dataSize = 4;
+            connectivity.send(reply, reverse->next_hop);
+        }
+
+        void aodv::send_errors() {
+            message error(AODV_ROUTING::ROUTE_ERROR, 0, connectivity.id, 0);
+            for (size_t i = 0; i < route_count; i++) {
+                route_entry &route = routes[i];
+                if (!route.broken) {
+                    continue;
+                }
+                route.broken = false;
+                if (error.dataSize + size_t(2) > message::payload_size) {
+                    connectivity.send_all(error);
+                    error.message_id = 0;
+                    error.dataSize = 0;
+                }
+                error.data[error.dataSize] = route.destination;
+                error.data[error.dataSize + 1] = route.sequence;
+                error.dataSize += 2;
+            }
+            if (error.dataSize > 0) {
+                connectivity.send_all(error);
+            }
+        }
+
+        void aodv::flush_buffer() {
+            for (size_t i = 0; i < buffer_count; i++) {
+                if (!buffer[i].in_use) {
+                    continue;
+                }
+                message &msg = buffer[i].msg;
+                node_id next_hop = 0;
+                if (connectivity.connection_state(msg.receiver) == ACCEPTED) {
+                    next_hop = msg.receiver;
+                } else if (route_entry *route = find_valid(msg.receiver)) {
+                    next_hop = route->next_hop;
+                }
+                if (next_hop != 0 && connectivity.send(msg, next_hop)) { // A full transmit queue is retried on the next update
+                    buffer[i].in_use = false;
+                }
+            }
+        }
+
+        void aodv::handle_request(const message &message) {
+            if (message.dataSize < 7) {
+                return;
+            }
+            node_id originator = message.data[0];
+            uint8_t originator_sequence = message.data[1];
+            node_id destination = message.data[3];
+            uint8_t destination_sequence = message.data[4];
+            uint8_t hop_count = message.data[5];
+            bool sequence_unknown = (message.data[6] & UNKNOWN_SEQUENCE) > 0;
+            if (originator == connectivity.id || !remember_request(originator, message.data[2])) {
+                return;
+            }
+
+            update_route(message.sender, message.sender, 1, 0, false);
+            update_route(originator, message.sender, uint8_t(hop_count + 1), originator_sequence, true);
+
+            if (destination == connectivity.id) {
+                if (!sequence_unknown && int8_t(destination_sequence - sequence) > 0) {
+                    sequence = destination_sequence;
+                }
+                send_reply(originator, destination, sequence, 0);
+                return;
+            }
+
+            route_entry *route = find_valid(destination);
+            if (route != nullptr && route->sequence_known &&
+                (sequence_unknown || int8_t(route->sequence - destination_sequence) >= 0)) {
+                send_reply(originator, destination, route->sequence, route->hop_count);
+                return;
+            }
+
+            if (hop_count + 1 < max_hops) {
+                mesh::message request(AODV_ROUTING::ROUTE_REQUEST, 0, connectivity.id, 0, message.dataSize,
+                                      message.data);
+                request.data[5] = uint8_t(hop_count + 1);
+                connectivity.send_all(request);
+            }
+        }
+
+        void aodv::handle_reply(const message &message) {
+            if (message.dataSize < 4) {
+                return;
+            }
+            node_id originator = message.data[0];
+            node_id destination = message.data[1];
+
+            update_route(message.sender, message.sender, 1, 0, false);
+            update_route(destination, message.sender, uint8_t(message.data[3] + 1), message.data[2], true);
+
+            route_entry *route = find_valid(destination);
+            if (originator != connectivity.id && route != nullptr) {
+                send_reply(originator, destination, route->sequence, route->hop_count);
+            }
+        }
+
+        void aodv::handle_error(const message &message) {
+            for (size_t i = 0; i + 2 <= message.dataSize; i += 2) {
+                route_entry *route = find_valid(message.data[i]);
+                if (route == nullptr || route->next_hop != message.sender) {
+                    continue;
+                }
+                route->valid = false;
+                route->broken = true;
+                route->sequence = message.data[i + 1];
+                route->sequence_known = true;
+            }
+            send_errors();
+        }
+
+        bool aodv::update_neighbours() {
+            bool changed = false;
+            for (size_t i = 0; i < route_count; i++) {
+                route_entry &route = routes[i];
+                if (!route.valid || connectivity.connection_state(route.next_hop) == ACCEPTED) {
+                    continue;
+                }
+                route.valid = false;
+                route.broken = true;
+                route.sequence++;
+                changed = true;
+            }
+            return changed;
+        }
+
+        void aodv::send_update() {
+            update_neighbours();
+            send_errors();
+        }
+
+        void aodv::on_routing_message(message &message) {
+            if (connectivity.connection_state(message.sender) != ACCEPTED) {
+                return;
+            }
+            switch (message.type) {
+                case AODV_ROUTING::ROUTE_REQUEST:
+                    handle_request(message);
+                    break;
+                case AODV_ROUTING::ROUTE_REPLY:
+                    handle_reply(message);
+                    break;
+                case AODV_ROUTING::ROUTE_ERROR:
+                    handle_error(message);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        void aodv::update() {
+            for (size_t i = 0; i < route_count; i++) {
+                route_entry &route = routes[i];
+                if (route.valid && --route.lifetime == 0) {
+                    route.valid = false;
+                }
+            }
+
+            for (seen_request &seen : seen_requests) {
+                if (seen.originator != 0 && ++seen.age >= request_memory) {
+                    seen.originator = 0;
+                }
+            }
+
+            for (discovery &search : discoveries) {
+                if (search.destination == 0 || --search.wait > 0) {
+                    continue;
+                }
+                if (search.attempts < max_discovery_attempts) {
+                    send_request(search);
+                    continue;
+                }
+                // No route found, drop the messages that were waiting for it
+                for (size_t i = 0; i < buffer_count; i++) {
+                    if (buffer[i].in_use && buffer[i].msg.receiver == search.destination) {
+                        buffer[i].in_use = false;
+                    }
+                }
+                search = {};
+            }
+
+            flush_buffer();
+        }
+
+        node_id aodv::get_next_hop(const node_id &receiver) {
+            if (connectivity.connection_state(receiver) == ACCEPTED) {
+                return receiver;
+            }
+            route_entry *route = find_valid(receiver);
+            if (route == nullptr) {
+                start_discovery(receiver);
+                return 0;
+            }
+            route->lifetime = active_route_timeout;
+            return route->next_hop;
+        }
+
+        bool aodv::on_unroutable(const message &message) {
+            for (size_t i = 0; i < buffer_count; i++) {
+                if (buffer[i].in_use) {
+                    continue;
+                }
+                if (!start_discovery(message.receiver)) {
+                    return false;
+                }
+                buffer[i].msg = message;
+                buffer[i].in_use = true;
+                return true;
+            }
+            return false;
+        }
+
+        size_t aodv::get_route_count() const {
+            return route_count;
+        }
+
+        const aodv::route_entry &aodv::get_route(size_t index) const {
+            return routes[index];
+        }
+    }
+}
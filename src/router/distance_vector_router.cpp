@@ -0,0 +1,227 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include <mesh/router/distance_vector_router.hpp>
+
+namespace mesh {
+    namespace routers {
+        distance_vector::distance_vector(connectivity_adapter &connectivity, size_t table_size) :
+                router(connectivity), table_size(table_size) {}
+
+        distance_vector::route_entry *distance_vector::find(const node_id &destination) {
+            for (size_t i = 0; i < table_size; i++) {
+                if (routes[i].destination == destination) {
+                    return &routes[i];
+                }
+            }
+            return nullptr;
+        }
+
+        distance_vector::route_entry *distance_vector::add(const node_id &destination) {
+            route_entry *free = nullptr;
+            for (size_t i = 0; i < table_size; i++) {
+                if (routes[i].destination == 0) {
+                    free = &routes[i];
+                    break;
+                }
+                if (free == nullptr && routes[i].metric == infinity && !routes[i].changed) {
+                    free = &routes[i];
+                }
+            }
+            if (free != nullptr) {
+                *free = {};
+                free->destination = destination;
+            }
+            return free;
+        }
+
+        void distance_vector::set_route(route_entry &route, const node_id &next_hop, uint8_t metric,
+                                        uint8_t route_sequence) {
+            if (route.next_hop != next_hop || route.metric != metric) {
+                route.changed = true;
+                triggered = true;
+            }
+            route.next_hop = next_hop;
+            route.metric = metric;
+            route.sequence = route_sequence;
+            if (route.changed && metric != infinity) {
+                routes_changed();
+            }
+        }
+
+        void distance_vector::process_entries(const message &message) {
+            node_id neighbour = message.sender;
+            if (connectivity.connection_state(neighbour) != ACCEPTED) {
+                return;
+            }
+            uint8_t link_cost = connectivity.link_cost(neighbour);
+
+            for (size_t i = 0; i + entry_size <= message.dataSize; i += entry_size) {
+                node_id destination = message.data[i];
+                uint8_t route_sequence = message.data[i + 1];
+                uint8_t metric = message.data[i + 2];
+                if (destination == connectivity.id && int8_t(route_sequence - sequence) > 0) {
+                    // A broken route (odd), or one from before a restart, is spreading. Replace it with a newer sequence number.
+                    // Neighbours echoing the current sequence are normal, and don't need a new one
+                    sequence = uint8_t((route_sequence + 2) & 0xFE);
+                    triggered = true;
+                }
+                if (destination == 0 || destination == connectivity.id) {
+                    continue;
+                }
+                metric = metric >= infinity - link_cost ? infinity : uint8_t(metric + link_cost);
+
+                route_entry *route = find(destination);
+                if (route == nullptr) {
+                    if (metric == infinity || (route = add(destination)) == nullptr) {
+                        continue;
+                    }
+                    set_route(*route, neighbour, metric, route_sequence);
+                    continue;
+                }
+
+                int8_t newer = int8_t(route_sequence - route->sequence);
+                if (route->next_hop == neighbour || newer > 0 || (newer == 0 && metric < route->metric)) {
+                    set_route(*route, neighbour, metric, route_sequence);
+                } else if (newer < 0 && route->metric != infinity) {
+                    // The neighbour has stale information, send it the newer route
+                    route->changed = true;
+                    triggered = true;
+                }
+            }
+        }
+
+        void distance_vector::send_entries(const message_type &type, bool changed_only) {
+            message update_message(type, 0, connectivity.id, 0);
+            update_message.data[0] = connectivity.id;
+            update_message.data[1] = sequence;
+            update_message.data[2] = 0;
+            size_t count = 1;
+
+            for (size_t i = 0; i < table_size; i++) {
+                route_entry &route = routes[i];
+                if (route.destination == 0 || (changed_only && !route.changed)) {
+                    continue;
+                }
+                route.changed = false;
+                if (count == entries_per_message) {
+                    update_message.dataSize = uint8_t(count * entry_size);
+                    connectivity.send_all(update_message);
+                    update_message.type = DISTANCE_VECTOR_ROUTING::UPDATE;
+                    update_message.message_id = 0; // Get a new id, or neighbours drop it as a duplicate
+                    count = 0;
+                }
+                update_message.data[count * entry_size] = route.destination;
+                update_message.data[count * entry_size + 1] = route.sequence;
+                update_message.data[count * entry_size + 2] = route.metric;
+                count++;
+            }
+
+            update_message.dataSize = uint8_t(count * entry_size);
+            connectivity.send_all(update_message);
+        }
+
+        bool distance_vector::update_neighbours() {
+            size_t count = connectivity.get_neighbour_count();
+            uint8_t neighbours[count];
+            connectivity.get_neighbours(neighbours);
+            bool changed = false;
+
+            for (size_t i = 0; i < table_size; i++) {
+                route_entry &route = routes[i];
+                if (route.destination == 0 || route.metric == infinity) {
+                    continue;
+                }
+                bool lost = true;
+                for (size_t j = 0; j < count && lost; j++) {
+                    lost = neighbours[j] != route.next_hop;
+                }
+                if (lost) {
+                    set_route(route, route.next_hop, infinity, uint8_t(route.sequence + 1));
+                    changed = true;
+                }
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                uint8_t cost = connectivity.link_cost(neighbours[i]);
+                route_entry *route = find(neighbours[i]);
+                if (route == nullptr) {
+                    if ((route = add(neighbours[i])) == nullptr) {
+                        continue;
+                    }
+                } else if (route->next_hop == neighbours[i] && route->metric != infinity) {
+                    uint8_t difference = cost > route->metric ? cost - route->metric : route->metric - cost;
+                    if (difference * 100 < route->metric * cost_hysteresis_percent) {
+                        continue;
+                    }
+                } else if (route->metric <= cost) {
+                    continue;
+                }
+                set_route(*route, neighbours[i], cost, route->sequence);
+                changed = true;
+            }
+            return changed;
+        }
+
+        void distance_vector::send_update() {
+            update_neighbours();
+            sequence += 2;
+            ticks_since_full_update = 0;
+            triggered = false;
+            send_entries(DISTANCE_VECTOR_ROUTING::UPDATE, false);
+        }
+
+        void distance_vector::initial_update() {
+            update_neighbours();
+            sequence += 2;
+            ticks_since_full_update = 0;
+            triggered = false;
+            send_entries(DISTANCE_VECTOR_ROUTING::UPDATE_REQUEST, false);
+        }
+
+        void distance_vector::on_routing_message(message &message) {
+            switch (message.type) {
+                case DISTANCE_VECTOR_ROUTING::UPDATE_REQUEST:
+                    process_entries(message);
+                    send_update();
+                    break;
+                case DISTANCE_VECTOR_ROUTING::UPDATE:
+                    process_entries(message);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        void distance_vector::update() {
+            if (++ticks_since_full_update >= full_update_interval) {
+                send_update();
+            } else if (triggered) {
+                triggered = false;
+                send_entries(DISTANCE_VECTOR_ROUTING::UPDATE, true);
+            }
+        }
+
+        node_id distance_vector::get_next_hop(const node_id &receiver) {
+            route_entry *route = find(receiver);
+            if (route == nullptr || route->metric == infinity) {
+                return 0;
+            }
+            return route->next_hop;
+        }
+
+        size_t distance_vector::get_table_size() const {
+            return table_size;
+        }
+
+        const distance_vector::route_entry &distance_vector::get_route(size_t index) const {
+            return routes[index];
+        }
+    }
+}
@@ -11,105 +11,503 @@
 
 namespace mesh {
     namespace routers {
-        void link_state::graph_update_other(const node_id &other, const message &message) {
-            std::array<node_id, 5> edges = {};
-            std::array<uint8_t, 5> costs = {};
+        bool link_state::graph_update_other(const node_id &other, const message &message) {
+            uint8_t page = message.data[2];
+            bool last_page = page + 1 == message.data[3];
+            size_t capacity = topology.get_edge_capacity();
+            size_t first = page * edges_per_page;
 
+            const auto *node = topology.find_node(other);
+            size_t known = node == nullptr ? 0 : node->edge_count;
+            if (first > known) { // Earlier pages are missing
+                return false;
+            }
+            if (first >= capacity) { // This page doesn't fit, the neighbour list is cut off like in set_edges
+                return true;
+            }
+
+            node_id edges[capacity];
+            uint8_t costs[capacity];
+            for (size_t i = 0; i < known; i++) {
+                edges[i] = node->edges[i];
+                costs[i] = node->edge_costs[i];
+            }
+
+            size_t count = first;
+            for (size_t i = update_header_size; i + 1 < message.dataSize && count < capacity; i += 2, count++) {
+                edges[count] = message.data[i];
+                costs[count] = message.data[i + 1];
+            }
+            if (!last_page && count < known) { // Keep the neighbours of the following pages
+                count = known;
+            }
+
+            if (topology.set_edges(other, edges, costs, count)) {
+                relays_outdated = true;
+                if (!topology.is_dirty()) {
+                    routes_changed();
+                }
+            }
+            return true;
+        }
+
+        void link_state::fill_update_message(message &message, uint8_t page) {
+            auto &me = topology.get_node(0);
+            size_t first = page * edges_per_page;
+            size_t count = me.edge_count > first ? me.edge_count - first : 0;
+            if (count > edges_per_page) {
+                count = edges_per_page;
+            }
+
+            message.data[0] = sequence;
+            message.data[1] = 0;
+            message.data[2] = page;
+            message.data[3] = page_count();
+            message.data[4] = connectivity.id;
+            message.dataSize = uint8_t(update_header_size + count * 2);
+            for (size_t i = 0; i < count; i++) {
+                message.data[update_header_size + i * 2] = me.edges[first + i];
+                message.data[update_header_size + i * 2 + 1] = me.edge_costs[first + i];
+            }
+        }
+
+        uint8_t link_state::page_count() const {
+            size_t count = topology.get_node(0).edge_count;
+            size_t pages = count == 0 ? 1 : (count + edges_per_page - 1) / edges_per_page;
+            return pages > max_pages ? max_pages : uint8_t(pages);
+        }
 
-            for (size_t i = 0; i < message.dataSize / 2; i++) {
-                edges[i] = message.data[i * 2];
-                costs[i] = message.data[i * 2 + 1];
+        void link_state::send_pages(const message_type &first_type) {
+            uint8_t pages = page_count();
+            for (uint8_t page = 0; page < pages; page++) {
+                message update_message(
+                        page == 0 ? first_type : LINK_STATE_ROUTING::UPDATE,
+                        0,
+                        connectivity.id,
+                        0
+                );
+                fill_update_message(update_message, page);
+                connectivity.send_all(update_message);
             }
+            sequence++;
+            advertised = true;
+            pending_count = 0;
+            pending_overflow = false;
+        }
 
+        void link_state::send_newest_pages(const node_id &receiver, const node_id &relay) {
+            node_id next_hop = topology.get_next_hop(receiver);
+            if (next_hop == 0) { // The request came in through the relay, so it leads back to the receiver
+                next_hop = relay;
+            }
+            uint8_t pages = page_count();
+            for (uint8_t page = 0; page < pages; page++) {
+                message update_message(
+                        LINK_STATE_ROUTING::UPDATE,
+                        0,
+                        connectivity.id,
+                        receiver
+                );
+                fill_update_message(update_message, page);
+                update_message.data[0] = uint8_t(sequence - 1);
+                connectivity.send(update_message, next_hop);
+            }
+        }
 
-            ls_calc.insert_replace({other, edges, costs});
-            is_updated = false;
+        void link_state::record_change(const node_id &neighbour, uint8_t cost) {
+            for (size_t i = 0; i < pending_count; i++) {
+                if (pending_changes[i].neighbour == neighbour) {
+                    pending_changes[i].cost = cost;
+                    return;
+                }
+            }
+            if (pending_count < pending_changes.size()) {
+                pending_changes[pending_count++] = {neighbour, cost};
+            } else {
+                pending_overflow = true;
+            }
         }
 
-        void link_state::fill_update_message(message &message) {
-            auto &me = ls_calc.get_node(0);
-            message.dataSize = uint8_t(me.edge_count * 2);
-            for (size_t i = 0; i < me.edge_count; i++) {
-                message.data[i * 2] = me.edges[i];
-                message.data[i * 2 + 1] = me.edge_costs[i];
+        void link_state::send_delta() {
+            message delta_message(
+                    LINK_STATE_ROUTING::UPDATE_DELTA,
+                    0,
+                    connectivity.id,
+                    0
+            );
+            delta_message.data[0] = sequence;
+            delta_message.data[1] = 0;
+            delta_message.data[2] = uint8_t(sequence - 1);
+            delta_message.data[3] = connectivity.id;
+            delta_message.dataSize = uint8_t(delta_header_size + pending_count * 2);
+            for (size_t i = 0; i < pending_count; i++) {
+                delta_message.data[delta_header_size + i * 2] = pending_changes[i].neighbour;
+                delta_message.data[delta_header_size + i * 2 + 1] = pending_changes[i].cost;
             }
-            is_updated = false;
+            connectivity.send_all(delta_message);
+            sequence++;
+            pending_count = 0;
         }
 
-        link_state::link_state(connectivity_adapter &connectivity) : router(connectivity),
-                                                                     ls_calc(connectivity.id) {
+        void link_state::graph_apply_delta(const node_id &other, const message &message) {
+            size_t capacity = topology.get_edge_capacity();
+            const auto *node = topology.find_node(other);
+            size_t count = node == nullptr ? 0 : node->edge_count;
+
+            node_id edges[capacity];
+            uint8_t costs[capacity];
+            for (size_t i = 0; i < count; i++) {
+                edges[i] = node->edges[i];
+                costs[i] = node->edge_costs[i];
+            }
+
+            for (size_t i = delta_header_size; i + 1 < message.dataSize; i += 2) {
+                node_id neighbour = message.data[i];
+                uint8_t cost = message.data[i + 1];
+                size_t j = 0;
+                while (j < count && edges[j] != neighbour) {
+                    j++;
+                }
+                if (cost == 0) {
+                    if (j < count) {
+                        count--;
+                        edges[j] = edges[count];
+                        costs[j] = costs[count];
+                    }
+                } else if (j < count) {
+                    costs[j] = cost;
+                } else if (count < capacity) {
+                    edges[count] = neighbour;
+                    costs[count++] = cost;
+                }
+            }
+
+            if (topology.set_edges(other, edges, costs, count)) {
+                relays_outdated = true;
+                if (!topology.is_dirty()) {
+                    routes_changed();
+                }
+            }
+        }
+
+        bool link_state::accept_delta(const message &message) {
+            if (message.dataSize < delta_header_size || message.sender == connectivity.id) {
+                return false;
+            }
+            uint8_t received_sequence = message.data[0];
+            advertisement_record &record = advertisements[message.sender];
+            if (record.known && int8_t(received_sequence - record.sequence) <= 0) {
+                return false;
+            }
+
+            bool has_base = record.known && record.sequence == message.data[2] && record.complete();
+            record.known = true;
+            record.sequence = received_sequence;
+            record.relayed_pages = 0;
+            if (has_base) {
+                graph_apply_delta(message.sender, message);
+                return true;
+            }
+
+            // Following deltas can't be applied either, until a complete update arrives
+            request_resync(message.sender);
+            return true;
+        }
+
+        void link_state::request_resync(const node_id &originator) {
+            advertisement_record &record = advertisements[originator];
+            record.pages = 0;
+            record.page_count = 0;
+            node_id next_hop = topology.get_next_hop(originator);
+            if (next_hop == 0) {
+                return;
+            }
+            message resync_message(
+                    LINK_STATE_ROUTING::RESYNC_REQUEST,
+                    0,
+                    connectivity.id,
+                    originator
+            );
+            connectivity.send(resync_message, next_hop);
+        }
+
+        bool link_state::accept_advertisement(const message &message) {
+            if (message.dataSize < update_header_size || message.data[2] >= message.data[3] ||
+                message.data[3] > max_pages || message.sender == connectivity.id) {
+                return false;
+            }
+            uint8_t received_sequence = message.data[0];
+            uint16_t page = uint16_t(1 << message.data[2]);
+            advertisement_record &record = advertisements[message.sender];
+
+            if (!record.known || int8_t(received_sequence - record.sequence) > 0 ||
+                (message.type == LINK_STATE_ROUTING::UPDATE_REQUEST && received_sequence != record.sequence)) {
+                record.known = true;
+                record.sequence = received_sequence;
+                record.pages = 0;
+                record.page_count = message.data[3];
+                record.relayed_pages = 0;
+                return true;
+            }
+            return received_sequence == record.sequence && (record.pages & page) == 0;
+        }
+
+        bool link_state::is_newest(const message &message) const {
+            if (message.type == LINK_STATE_ROUTING::UPDATE_DELTA) {
+                if (message.dataSize < delta_header_size) {
+                    return false;
+                }
+            } else if (message.dataSize < update_header_size || message.data[2] >= message.data[3] ||
+                       message.data[3] > max_pages) {
+                return false;
+            }
+            const advertisement_record &record = advertisements[message.sender];
+            return message.sender != connectivity.id && record.known && record.sequence == message.data[0];
+        }
+
+        void link_state::use_page(const message &message) {
+            advertisement_record &record = advertisements[message.sender];
+            if (!graph_update_other(message.sender, message)) {
+                request_resync(message.sender);
+                return;
+            }
+            record.pages |= uint16_t(1 << message.data[2]);
+            record.page_count = message.data[3];
+        }
+
+        link_state::link_state(connectivity_adapter &connectivity, link_state_topology &topology) :
+                router(connectivity), topology(topology) {
+            topology.reset(connectivity.id);
             update_neighbours();
         }
 
-        void link_state::update_neighbours() {
+        bool link_state::update_neighbours() {
 //            connectivity.status();
             size_t count = connectivity.get_neighbour_count();
             uint8_t neighbours[count];
             connectivity.get_neighbours(neighbours);
-            auto &me = ls_calc.get_node(0);
-            me.edge_count = uint8_t(count);
+            if (count > topology.get_edge_capacity()) {
+                count = topology.get_edge_capacity();
+            }
+            auto &me = topology.get_node(0);
+            uint8_t costs[count];
+
             for (size_t i = 0; i < count; i++) {
-                me.edges[i] = neighbours[i];
-                me.edge_costs[i] = 1; //Todo actual cost
+                uint8_t cost = connectivity.link_cost(neighbours[i]);
+                bool changed = true;
+                for (size_t j = 0; j < me.edge_count; j++) {
+                    if (me.edges[j] != neighbours[i]) {
+                        continue;
+                    }
+                    uint8_t difference = cost > me.edge_costs[j] ? cost - me.edge_costs[j] : me.edge_costs[j] - cost;
+                    if (difference * 100 < me.edge_costs[j] * cost_hysteresis_percent) {
+                        cost = me.edge_costs[j];
+                    }
+                    changed = cost != me.edge_costs[j];
+                    break;
+                }
+                if (changed) {
+                    record_change(neighbours[i], cost);
+                }
+                costs[i] = cost;
+            }
+
+            for (size_t j = 0; j < me.edge_count; j++) {
+                bool removed = true;
+                for (size_t i = 0; i < count && removed; i++) {
+                    removed = neighbours[i] != me.edges[j];
+                }
+                if (removed) {
+                    record_change(me.edges[j], 0);
+                    relay_states[me.edges[j]] = RELAY_UNKNOWN;
+                }
+            }
+            if (!topology.set_edges(connectivity.id, neighbours, costs, count)) {
+                return false;
             }
+            relays_outdated = true;
+            if (!topology.is_dirty()) {
+                routes_changed();
+            }
+            return true;
         }
 
-        void link_state::send_update() {
-            update_neighbours();
-            message update_message(
-                    LINK_STATE_ROUTING::UPDATE,
+        void link_state::update_relays() {
+            node_id selection[max_relays];
+            size_t count = topology.select_relays(selection, max_relays);
+            bool changed = !relays_selected || count != relay_count;
+            for (size_t i = 0; i < count && !changed; i++) {
+                changed = true;
+                for (size_t j = 0; j < relay_count && changed; j++) {
+                    changed = relays[j] != selection[i];
+                }
+            }
+            relays_selected = true;
+            if (!changed) {
+                return;
+            }
+            relay_count = count;
+            for (size_t i = 0; i < count; i++) {
+                relays[i] = selection[i];
+            }
+            send_relays();
+        }
+
+        void link_state::send_relays() {
+            message select_message(
+                    LINK_STATE_ROUTING::MPR_SELECT,
                     0,
                     connectivity.id,
                     0
             );
-            fill_update_message(update_message);
-            connectivity.send_all(update_message);
+            for (size_t i = 0; i < relay_count; i++) {
+                select_message.data[i] = relays[i];
+            }
+            select_message.dataSize = uint8_t(relay_count);
+            relays_unsent = !connectivity.send_all(select_message);
+        }
+
+        void link_state::relay_update(message &message, size_t relay_index) {
+            if (message.receiver != 0) { // Sent to this node only, as an answer to an UPDATE_REQUEST
+                return;
+            }
+            advertisement_record &record = advertisements[message.sender];
+            uint16_t page = message.type == LINK_STATE_ROUTING::UPDATE_DELTA ? 1 : uint16_t(1 << message.data[2]);
+            if ((record.relayed_pages & page) != 0 || message.data[1] + 1 >= max_age) {
+                return;
+            }
+            if (relay_states[message.data[relay_index]] == RELAY_NOT_SELECTED) {
+                suppressed_count++;
+                return;
+            }
+            record.relayed_pages |= page;
+            message.data[1]++;
+            message.data[relay_index] = connectivity.id;
+            relayed_count++;
+            connectivity.send_all(message);
+        }
 
+        void link_state::send_update() {
+            update_neighbours();
+            if (advertised && pending_count > 0 && !pending_overflow) {
+                send_delta();
+            } else {
+                send_pages(LINK_STATE_ROUTING::UPDATE);
+            }
         }
 
         void link_state::initial_update() {
             update_neighbours();
-            message message = {
-                    LINK_STATE_ROUTING::UPDATE_REQUEST,
-                    0,
-                    connectivity.id,
-                    0
-            };
-            fill_update_message(message);
-            connectivity.send_all(message);
+            send_pages(LINK_STATE_ROUTING::UPDATE_REQUEST);
         }
 
         void link_state::on_routing_message(message &message) {
             switch (message.type) {
                 case LINK_STATE_ROUTING::UPDATE_REQUEST: {
-                    graph_update_other(message.sender, message);
-                    send_update();
+                    if (!accept_advertisement(message)) {
+                        on_duplicate_routing_message(message);
+                        return;
+                    }
+                    use_page(message);
+                    if (update_neighbours() || pending_count > 0 || pending_overflow || !advertised) {
+                        send_pages(LINK_STATE_ROUTING::UPDATE);
+                    } else {
+                        send_newest_pages(message.sender, message.data[update_header_size - 1]);
+                    }
+                    relay_update(message, update_header_size - 1);
                     break;
                 }
                 case LINK_STATE_ROUTING::UPDATE: {
-                    graph_update_other(message.sender, message);
+                    if (!accept_advertisement(message)) {
+                        on_duplicate_routing_message(message);
+                        return;
+                    }
+                    use_page(message);
+                    relay_update(message, update_header_size - 1);
+                    break;
+                }
+                case LINK_STATE_ROUTING::UPDATE_DELTA: {
+                    if (!accept_delta(message)) {
+                        on_duplicate_routing_message(message);
+                        return;
+                    }
+                    relay_update(message, delta_header_size - 1);
+                    break;
+                }
+                case LINK_STATE_ROUTING::RESYNC_REQUEST: {
+                    if (message.receiver == connectivity.id) {
+                        update_neighbours();
+                        send_pages(LINK_STATE_ROUTING::UPDATE);
+                    }
+                    break;
+                }
+                case LINK_STATE_ROUTING::MPR_SELECT: {
+                    relay_selection selection = RELAY_NOT_SELECTED;
+                    for (size_t i = 0; i < message.dataSize; i++) {
+                        if (message.data[i] == connectivity.id) {
+                            selection = RELAY_SELECTED;
+                        }
+                    }
+                    relay_states[message.sender] = selection;
                     break;
                 }
                 default:
                     break;
             }
+        }
 
-            connectivity.send_all(message);
+        void link_state::on_duplicate_routing_message(message &message) {
+            if ((message.type != LINK_STATE_ROUTING::UPDATE && message.type != LINK_STATE_ROUTING::UPDATE_REQUEST &&
+                 message.type != LINK_STATE_ROUTING::UPDATE_DELTA) || !is_newest(message)) {
+                return;
+            }
+            relay_update(message, message.type == LINK_STATE_ROUTING::UPDATE_DELTA ? delta_header_size - 1 :
+                                  update_header_size - 1);
+        }
+
+        void link_state::update() {
+            if (topology.is_dirty() && ++dirty_ticks >= recalculation_delay) {
+                dirty_ticks = 0;
+                topology.recalculate();
+                routes_changed();
+            }
+            topology.update_backups();
+            if (relays_outdated) {
+                relays_outdated = false;
+                update_relays();
+            } else if (relays_unsent) {
+                send_relays();
+            }
+        }
 
+        void link_state::set_recalculation_delay(uint16_t delay) {
+            recalculation_delay = delay;
+            dirty_ticks = 0;
+            topology.set_deferred(delay != 0);
         }
 
         node_id link_state::get_next_hop(const node_id &receiver) {
-            if (!is_updated) {
-                is_updated = true;
-                ls_calc.setup();
-                ls_calc.loop();
-                ls_calc.cleanup();
-            }
-            return ls_calc.get_next_hop(receiver);
+            return topology.get_next_hop(receiver);
+        }
+
+        size_t link_state::get_next_hops(const node_id &receiver, node_id next_hops[], size_t max_count) {
+            return topology.get_next_hops(receiver, next_hops, max_count);
+        }
+
+        node_id link_state::get_backup_hop(const node_id &receiver) {
+            return topology.get_backup_hop(receiver);
+        }
+
+        uint16_t link_state::get_relayed_count() const {
+            return relayed_count;
+        }
+
+        uint16_t link_state::get_suppressed_count() const {
+            return suppressed_count;
         }
 
-        calculator<node_id, uint8_t, 5, 10> &link_state::get_calculator() {
-            return ls_calc;
+        const link_state_topology &link_state::get_topology() const {
+            return topology;
         }
 
 
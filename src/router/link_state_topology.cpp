@@ -0,0 +1,451 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include <mesh/router/link_state_topology.hpp>
+
+namespace mesh {
+    namespace routers {
+        link_state_topology::link_state_topology(size_t node_capacity, size_t edge_capacity) :
+                node_capacity(node_capacity), edge_capacity(edge_capacity) {
+            node_index.fill(no_node);
+        }
+
+        void link_state_topology::reset(const node_id &own_id) {
+            node_index.fill(no_node);
+            routes.fill({});
+            node_count = 0;
+            dirty = false;
+            backups_outdated = false;
+            find_or_add(own_id);
+            routes[own_id].distance = 0;
+        }
+
+        void link_state_topology::set_deferred(bool defer) {
+            deferred = defer;
+            if (!deferred && dirty) {
+                recalculate();
+            }
+        }
+
+        bool link_state_topology::is_dirty() const {
+            return dirty;
+        }
+
+        void link_state_topology::recalculate() {
+            for (size_t i = 1; i < node_count; i++) {
+                nodes[i].parent = no_node;
+                nodes[i].queued = false;
+                routes[nodes[i].id] = {};
+            }
+            dirty = false;
+            relax(0);
+            run_queue();
+        }
+
+        size_t link_state_topology::find_or_add(const node_id &id) {
+            size_t index = find(id);
+            if (index == node_capacity && node_count < node_capacity) {
+                index = node_count++;
+                topology_node &node = nodes[index];
+                node.id = id;
+                node.edge_count = 0;
+                node.first_hops = 0;
+                node.parent = no_node;
+                node.queued = false;
+                node_index[id] = uint8_t(index);
+            }
+            return index;
+        }
+
+        void link_state_topology::detach_subtree(size_t root, bool detached[]) const {
+            detached[root] = true;
+            bool found = true;
+            while (found) {
+                found = false;
+                for (size_t i = 1; i < node_count; i++) {
+                    if (!detached[i] && nodes[i].parent != no_node && detached[nodes[i].parent]) {
+                        detached[i] = true;
+                        found = true;
+                    }
+                }
+            }
+        }
+
+        void link_state_topology::relax(size_t index) {
+            const topology_node &from = nodes[index];
+            const route &from_route = routes[from.id];
+            if (from_route.distance == unreachable) {
+                return;
+            }
+            for (size_t i = 0; i < from.edge_count; i++) {
+                size_t to_index = find(from.edges[i]);
+                if (to_index == node_capacity || to_index == 0) {
+                    continue;
+                }
+                route &to_route = routes[from.edges[i]];
+                uint32_t distance = uint32_t(from_route.distance) + from.edge_costs[i];
+                if (distance < to_route.distance) {
+                    to_route.distance = uint16_t(distance);
+                    to_route.next_hop = index == 0 ? from.edges[i] : from_route.next_hop;
+                    nodes[to_index].parent = uint8_t(index);
+                    nodes[to_index].queued = true;
+                }
+            }
+        }
+
+        void link_state_topology::run_queue() {
+            while (true) {
+                size_t next = node_capacity;
+                for (size_t i = 0; i < node_count; i++) {
+                    if (nodes[i].queued && (next == node_capacity ||
+                                       routes[nodes[i].id].distance < routes[nodes[next].id].distance)) {
+                        next = i;
+                    }
+                }
+                if (next == node_capacity) {
+                    return;
+                }
+                nodes[next].queued = false;
+                relax(next);
+            }
+        }
+
+        void link_state_topology::update_first_hops() {
+            size_t order[node_count];
+            size_t reachable = 0;
+            for (size_t i = 0; i < node_count; i++) {
+                nodes[i].first_hops = 0;
+                uint16_t distance = routes[nodes[i].id].distance;
+                if (distance == unreachable) {
+                    continue;
+                }
+                size_t j = reachable++;
+                for (; j > 0 && routes[nodes[order[j - 1]].id].distance > distance; j--) {
+                    order[j] = order[j - 1];
+                }
+                order[j] = i;
+            }
+
+            for (size_t k = 0; k < reachable; k++) {
+                const topology_node &from = nodes[order[k]];
+                uint16_t from_distance = routes[from.id].distance;
+                for (size_t i = 0; i < from.edge_count; i++) {
+                    size_t to_index = find(from.edges[i]);
+                    if (to_index == node_capacity || to_index == 0 ||
+                        from_distance + from.edge_costs[i] != routes[from.edges[i]].distance ||
+                        from.edge_costs[i] == 0) {
+                        continue;
+                    }
+                    if (order[k] != 0) {
+                        nodes[to_index].first_hops |= from.first_hops;
+                    } else if (i < 32) {
+                        nodes[to_index].first_hops |= uint32_t(1) << i;
+                    }
+                }
+            }
+        }
+
+        void link_state_topology::distances_from(size_t root, uint16_t distance[]) const {
+            bool done[node_count];
+            for (size_t i = 0; i < node_count; i++) {
+                distance[i] = unreachable;
+                done[i] = false;
+            }
+            distance[root] = 0;
+            while (true) {
+                size_t next = node_capacity;
+                for (size_t i = 0; i < node_count; i++) {
+                    if (!done[i] && distance[i] != unreachable && (next == node_capacity || distance[i] < distance[next])) {
+                        next = i;
+                    }
+                }
+                if (next == node_capacity) {
+                    return;
+                }
+                done[next] = true;
+                const topology_node &from = nodes[next];
+                for (size_t i = 0; i < from.edge_count; i++) {
+                    size_t to_index = find(from.edges[i]);
+                    if (to_index == node_capacity) {
+                        continue;
+                    }
+                    uint32_t to_distance = uint32_t(distance[next]) + from.edge_costs[i];
+                    if (to_distance < distance[to_index]) {
+                        distance[to_index] = uint16_t(to_distance);
+                    }
+                }
+            }
+        }
+
+        void link_state_topology::update_backups() {
+            if (!backups_outdated || dirty) {
+                return;
+            }
+            backups_outdated = false;
+            update_first_hops();
+            uint32_t best[node_count];
+            for (size_t i = 0; i < node_count; i++) {
+                routes[nodes[i].id].backup_hop = 0;
+                best[i] = UINT32_MAX;
+            }
+
+            const topology_node &self = nodes[0];
+            uint16_t distance[node_count];
+            for (size_t i = 0; i < self.edge_count; i++) {
+                node_id neighbour = self.edges[i];
+                size_t neighbour_index = find(neighbour);
+                if (neighbour_index == node_capacity || neighbour_index == 0) {
+                    continue;
+                }
+                distances_from(neighbour_index, distance);
+                for (size_t j = 1; j < node_count; j++) {
+                    route &destination = routes[nodes[j].id];
+                    if (destination.distance == unreachable || distance[j] == unreachable ||
+                        destination.next_hop == neighbour) {
+                        continue;
+                    }
+                    // The neighbour's own shortest path would come back through this node
+                    if (uint32_t(distance[j]) >= uint32_t(distance[0]) + destination.distance) {
+                        continue;
+                    }
+                    uint32_t cost = uint32_t(self.edge_costs[i]) + distance[j];
+                    if (cost < best[j]) {
+                        best[j] = cost;
+                        destination.backup_hop = neighbour;
+                    }
+                }
+            }
+        }
+
+        bool link_state_topology::set_edges(const node_id &id, const node_id *edges, const uint8_t *costs,
+                                            size_t count) {
+            if (count > edge_capacity) {
+                count = edge_capacity;
+            }
+            size_t index = find_or_add(id);
+            if (index == node_capacity) {
+                return false;
+            }
+
+            topology_node &node = nodes[index];
+            bool changed = node.edge_count != count;
+            for (size_t i = 0; i < count && !changed; i++) {
+                changed = true;
+                for (size_t j = 0; j < node.edge_count; j++) {
+                    if (node.edges[j] == edges[i]) {
+                        changed = node.edge_costs[j] != costs[i];
+                        break;
+                    }
+                }
+            }
+            if (!changed) {
+                return false;
+            }
+            backups_outdated = true;
+
+            size_t old_count = node.edge_count;
+            node_id old_edges[old_count];
+            uint8_t old_costs[old_count];
+            for (size_t i = 0; i < old_count; i++) {
+                old_edges[i] = node.edges[i];
+                old_costs[i] = node.edge_costs[i];
+            }
+            node.edge_count = uint8_t(count);
+            for (size_t i = 0; i < count; i++) {
+                node.edges[i] = edges[i];
+                node.edge_costs[i] = costs[i];
+                find_or_add(edges[i]);
+            }
+
+            if (deferred) {
+                dirty = true;
+                return true;
+            }
+            if (routes[id].distance == unreachable) { // No shortest path runs through this node
+                return true;
+            }
+
+            // Edges in the tree that got more expensive or were removed detach their subtree
+            bool detached[node_count];
+            for (size_t i = 0; i < node_count; i++) {
+                detached[i] = false;
+            }
+            bool any_detached = false;
+            for (size_t i = 0; i < old_count; i++) {
+                size_t to_index = find(old_edges[i]);
+                if (to_index == node_capacity || nodes[to_index].parent != index) {
+                    continue;
+                }
+                bool worse = true;
+                for (size_t j = 0; j < count; j++) {
+                    if (edges[j] == old_edges[i]) {
+                        worse = costs[j] > old_costs[i];
+                        break;
+                    }
+                }
+                if (worse) {
+                    detach_subtree(to_index, detached);
+                    any_detached = true;
+                }
+            }
+
+            if (any_detached) {
+                for (size_t i = 1; i < node_count; i++) {
+                    if (detached[i]) {
+                        nodes[i].parent = no_node;
+                        routes[nodes[i].id] = {};
+                        nodes[i].queued = false;
+                    }
+                }
+                // Reattach the detached nodes through the rest of the tree
+                for (size_t i = 0; i < node_count; i++) {
+                    if (!detached[i]) {
+                        relax(i);
+                    }
+                }
+            }
+
+            // Cheaper and new edges can only improve the nodes they point to
+            relax(index);
+            run_queue();
+            return true;
+        }
+
+        size_t link_state_topology::get_next_hops(const node_id &destination, node_id next_hops[],
+                                                  size_t max_count) const {
+            size_t destination_index = find(destination);
+            if (max_count == 0 || destination_index == node_capacity || destination_index == 0 ||
+                routes[destination].distance == unreachable) {
+                return 0;
+            }
+            next_hops[0] = routes[destination].next_hop;
+            size_t count = 1;
+            if (dirty || backups_outdated) {
+                return count;
+            }
+
+            const topology_node &self = nodes[0];
+            uint32_t first_hops = nodes[destination_index].first_hops;
+            for (size_t i = 0; i < self.edge_count && i < 32 && count < max_count; i++) {
+                if ((first_hops & (uint32_t(1) << i)) != 0 && self.edges[i] != next_hops[0]) {
+                    next_hops[count++] = self.edges[i];
+                }
+            }
+            return count;
+        }
+
+        size_t link_state_topology::select_relays(node_id relays[], size_t max_count) const {
+            const topology_node &self = nodes[0];
+            size_t neighbour_count = self.edge_count;
+            bool is_neighbour[node_count];
+            bool uncovered[node_count];
+            for (size_t i = 0; i < node_count; i++) {
+                is_neighbour[i] = false;
+                uncovered[i] = false;
+            }
+            for (size_t i = 0; i < neighbour_count; i++) {
+                size_t index = find(self.edges[i]);
+                if (index != node_capacity) {
+                    is_neighbour[index] = true;
+                }
+            }
+            for (size_t i = 0; i < neighbour_count; i++) {
+                const topology_node *neighbour = find_node(self.edges[i]);
+                for (size_t j = 0; neighbour != nullptr && j < neighbour->edge_count; j++) {
+                    size_t index = find(neighbour->edges[j]);
+                    if (index != node_capacity && index != 0 && !is_neighbour[index]) {
+                        uncovered[index] = true;
+                    }
+                }
+            }
+
+            bool selected[neighbour_count];
+            for (size_t i = 0; i < neighbour_count; i++) {
+                // Neighbours that didn't advertise their edges yet might be the only way to reach any node
+                const topology_node *neighbour = find_node(self.edges[i]);
+                selected[i] = neighbour == nullptr || neighbour->edge_count == 0;
+            }
+            // Neighbours that are the only way to reach a 2-hop neighbour
+            for (size_t index = 1; index < node_count; index++) {
+                if (!uncovered[index]) {
+                    continue;
+                }
+                size_t only = neighbour_count;
+                size_t reach_count = 0;
+                for (size_t i = 0; i < neighbour_count; i++) {
+                    const topology_node *neighbour = find_node(self.edges[i]);
+                    for (size_t j = 0; neighbour != nullptr && j < neighbour->edge_count; j++) {
+                        if (neighbour->edges[j] == nodes[index].id) {
+                            only = i;
+                            reach_count++;
+                            break;
+                        }
+                    }
+                }
+                if (reach_count == 1) {
+                    selected[only] = true;
+                }
+            }
+
+            size_t count = 0;
+            while (true) {
+                // Remove everything the selected neighbours reach
+                for (size_t i = 0; i < neighbour_count; i++) {
+                    const topology_node *neighbour = find_node(self.edges[i]);
+                    for (size_t j = 0; selected[i] && neighbour != nullptr && j < neighbour->edge_count; j++) {
+                        size_t index = find(neighbour->edges[j]);
+                        if (index != node_capacity) {
+                            uncovered[index] = false;
+                        }
+                    }
+                }
+                // And add the neighbour that reaches the most of the rest
+                size_t best = neighbour_count;
+                size_t best_reach = 0;
+                for (size_t i = 0; i < neighbour_count; i++) {
+                    const topology_node *neighbour = find_node(self.edges[i]);
+                    size_t reach = 0;
+                    for (size_t j = 0; !selected[i] && neighbour != nullptr && j < neighbour->edge_count; j++) {
+                        size_t index = find(neighbour->edges[j]);
+                        if (index != node_capacity && uncovered[index]) {
+                            reach++;
+                        }
+                    }
+                    if (reach > best_reach) {
+                        best = i;
+                        best_reach = reach;
+                    }
+                }
+                if (best == neighbour_count) {
+                    break;
+                }
+                selected[best] = true;
+            }
+
+            for (size_t i = 0; i < neighbour_count && count < max_count; i++) {
+                if (selected[i]) {
+                    relays[count++] = self.edges[i];
+                }
+            }
+            return count;
+        }
+
+        size_t link_state_topology::get_node_count() const {
+            return node_count;
+        }
+
+        const link_state_topology::topology_node &link_state_topology::get_node(size_t index) const {
+            return nodes[index];
+        }
+
+        size_t link_state_topology::get_edge_capacity() const {
+            return edge_capacity;
+        }
+    }
+}
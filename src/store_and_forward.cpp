@@ -0,0 +1,60 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include <mesh/store_and_forward.hpp>
+
+mesh::store_and_forward::store_and_forward(size_t capacity, uint8_t per_destination_limit, uint16_t ttl)
+        : capacity(capacity), per_destination_limit(per_destination_limit), ttl(ttl) {}
+
+bool mesh::store_and_forward::store(const mesh::message &msg) {
+    uint8_t destination_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (messages[i].msg.receiver == msg.receiver) {
+            destination_count++;
+        }
+    }
+    if (count == capacity || destination_count >= per_destination_limit) {
+        dropped_count++;
+        return false;
+    }
+    messages[count].age = 0;
+    messages[count].msg = msg;
+    count++;
+    return true;
+}
+
+void mesh::store_and_forward::tick() {
+    for (size_t i = 0; i < count;) {
+        if (++messages[i].age > ttl) {
+            dropped_count++;
+            remove(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+size_t mesh::store_and_forward::get_count() const {
+    return count;
+}
+
+const mesh::message &mesh::store_and_forward::get(size_t index) const {
+    return messages[index].msg;
+}
+
+void mesh::store_and_forward::remove(size_t index) {
+    for (size_t i = index; i + 1 < count; i++) {
+        messages[i] = messages[i + 1];
+    }
+    count--;
+}
+
+uint16_t mesh::store_and_forward::get_dropped_count() const {
+    return dropped_count;
+}
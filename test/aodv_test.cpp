@@ -0,0 +1,267 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include "test.hpp"
+#include "fake_adapter.hpp"
+#include <mesh/router/aodv_router.hpp>
+#include <algorithm>
+
+using mesh_test::fake_adapter;
+using mesh::routers::aodv;
+using mesh::AODV_ROUTING;
+
+namespace {
+    typedef std::vector<uint8_t> payload;
+
+    mesh::message routing_message(const mesh::message_type &type, const mesh::node_id &sender, const payload &data) {
+        mesh::message msg(type, 0, sender, 0);
+        std::copy(data.begin(), data.end(), msg.data.begin());
+        msg.dataSize = uint8_t(data.size());
+        return msg;
+    }
+
+    /// Route request, as passed on by sender
+    mesh::message request(const mesh::node_id &sender, const mesh::node_id &originator, uint8_t request_id,
+                          const mesh::node_id &destination, uint8_t destination_sequence, uint8_t hop_count) {
+        return routing_message(AODV_ROUTING::ROUTE_REQUEST, sender,
+                               {originator, 3, request_id, destination, destination_sequence, hop_count,
+                                uint8_t(destination_sequence == 0 ? aodv::UNKNOWN_SEQUENCE : 0)});
+    }
+
+    /// Payloads of the frames of a type that were sent to a next hop
+    std::vector<payload> sent_payloads(fake_adapter &adapter, const mesh::message_type &type,
+                                       const mesh::node_id &next_hop) {
+        adapter.drain();
+        std::vector<payload> payloads;
+        for (const auto &frame : adapter.sent) {
+            if (frame.type() == type && frame.next_hop == next_hop) {
+                auto data = frame.bytes.begin() + mesh::message::header_size;
+                payloads.emplace_back(data, data + frame.bytes[5]);
+            }
+        }
+        return payloads;
+    }
+
+    /// Node 1, with neighbours 5 and 6
+    struct fixture {
+        fake_adapter adapter{1};
+        mesh::routers::aodv_router<8, 2> router{adapter};
+
+        fixture() {
+            adapter.neighbours = {5, 6};
+        }
+
+        /// Learn a route to 9 through 5, with destination sequence number 7 and 3 hops
+        void route_to_9() {
+            mesh::message reply = routing_message(AODV_ROUTING::ROUTE_REPLY, 5, {1, 9, 7, 2});
+            router.on_routing_message(reply);
+            adapter.drain();
+            adapter.sent.clear();
+        }
+    };
+}
+
+TEST(a_missing_route_floods_a_request) {
+    fixture f;
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(5));
+    CHECK_EQUAL(mesh::node_id(0), f.router.get_next_hop(9));
+    std::vector<payload> requests = sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REQUEST, 6);
+    CHECK_EQUAL(size_t(1), requests.size());
+    CHECK(requests[0] == payload({1, 1, 1, 9, 0, 0, aodv::UNKNOWN_SEQUENCE}));
+    f.adapter.sent.clear();
+
+    // The discovery is already running
+    CHECK_EQUAL(mesh::node_id(0), f.router.get_next_hop(9));
+    CHECK(f.adapter.sent.empty());
+}
+
+TEST(a_reply_creates_the_route) {
+    fixture f;
+    f.route_to_9();
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(9));
+    const aodv::route_entry *route = nullptr;
+    for (size_t i = 0; i < f.router.get_route_count(); i++) {
+        if (f.router.get_route(i).destination == 9) {
+            route = &f.router.get_route(i);
+        }
+    }
+    CHECK(route != nullptr && route->hop_count == 3 && route->sequence == 7);
+}
+
+TEST(requests_are_passed_on_once) {
+    fixture f;
+    mesh::message msg = request(5, 20, 1, 9, 0, 2);
+    f.router.on_routing_message(msg);
+    std::vector<payload> requests = sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REQUEST, 6);
+    CHECK_EQUAL(size_t(1), requests.size());
+    CHECK(requests[0] == payload({20, 3, 1, 9, 0, 3, aodv::UNKNOWN_SEQUENCE}));
+    // The request created a route back to its originator
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(20));
+    f.adapter.sent.clear();
+
+    msg = request(6, 20, 1, 9, 0, 2);
+    f.router.on_routing_message(msg);
+    CHECK(sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REQUEST, 5).empty());
+    f.adapter.sent.clear();
+    // Requests that travelled too far are not passed on
+    msg = request(5, 20, 2, 9, 0, aodv::max_hops - 1);
+    f.router.on_routing_message(msg);
+    CHECK(sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REQUEST, 6).empty());
+}
+
+TEST(the_destination_replies_to_a_request) {
+    fixture f;
+    mesh::message msg = request(5, 20, 1, 1, 0, 2);
+    f.router.on_routing_message(msg);
+    std::vector<payload> replies = sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REPLY, 5);
+    CHECK_EQUAL(size_t(1), replies.size());
+    CHECK(replies[0] == payload({20, 1, 0, 0}));
+    f.adapter.sent.clear();
+
+    // A newer sequence number for this node is taken over
+    msg = request(6, 21, 1, 1, 12, 0);
+    f.router.on_routing_message(msg);
+    replies = sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REPLY, 6);
+    CHECK(replies.size() == 1 && replies[0] == payload({21, 1, 12, 0}));
+}
+
+TEST(nodes_with_a_fresh_route_reply_for_the_destination) {
+    fixture f;
+    f.route_to_9();
+    mesh::message msg = request(6, 20, 1, 9, 5, 0);
+    f.router.on_routing_message(msg);
+    std::vector<payload> replies = sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REPLY, 6);
+    CHECK(replies.size() == 1 && replies[0] == payload({20, 9, 7, 3}));
+    f.adapter.sent.clear();
+
+    // The requester knows a newer sequence number than this route, so the request is passed on
+    msg = request(6, 20, 2, 9, 8, 0);
+    f.router.on_routing_message(msg);
+    CHECK(sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REPLY, 6).empty());
+    CHECK_EQUAL(size_t(1), sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REQUEST, 5).size());
+}
+
+TEST(replies_travel_back_to_the_originator) {
+    fixture f;
+    mesh::message msg = request(6, 20, 1, 9, 0, 1);
+    f.router.on_routing_message(msg);
+    f.adapter.drain();
+    f.adapter.sent.clear();
+
+    msg = routing_message(AODV_ROUTING::ROUTE_REPLY, 5, {20, 9, 7, 2});
+    f.router.on_routing_message(msg);
+    std::vector<payload> replies = sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REPLY, 6);
+    CHECK(replies.size() == 1 && replies[0] == payload({20, 9, 7, 3}));
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(9));
+}
+
+TEST(route_errors_break_routes_through_their_sender) {
+    fixture f;
+    f.route_to_9();
+    // Only the next hop of a route can break it
+    mesh::message msg = routing_message(AODV_ROUTING::ROUTE_ERROR, 6, {9, 8});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(9));
+    CHECK(sent_payloads(f.adapter, AODV_ROUTING::ROUTE_ERROR, 6).empty());
+    f.adapter.sent.clear();
+
+    msg = routing_message(AODV_ROUTING::ROUTE_ERROR, 5, {9, 8});
+    f.router.on_routing_message(msg);
+    std::vector<payload> errors = sent_payloads(f.adapter, AODV_ROUTING::ROUTE_ERROR, 6);
+    CHECK(errors.size() == 1 && errors[0] == payload({9, 8}));
+    CHECK_EQUAL(mesh::node_id(0), f.router.get_next_hop(9));
+}
+
+TEST(losing_a_next_hop_breaks_its_routes) {
+    fixture f;
+    f.route_to_9();
+    f.adapter.neighbours = {6};
+    f.router.send_update();
+    // The route to 5 itself breaks too, it was learned from the reply
+    std::vector<payload> errors = sent_payloads(f.adapter, AODV_ROUTING::ROUTE_ERROR, 6);
+    CHECK(errors.size() == 1 && errors[0] == payload({5, 1, 9, 8}));
+    CHECK(!f.router.update_neighbours());
+
+    // The broken route doesn't come back with its old sequence number
+    mesh::message msg = routing_message(AODV_ROUTING::ROUTE_REPLY, 6, {1, 9, 7, 1});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(0), f.router.get_next_hop(9));
+    msg = routing_message(AODV_ROUTING::ROUTE_REPLY, 6, {1, 9, 9, 1});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(6), f.router.get_next_hop(9));
+}
+
+TEST(buffered_messages_are_sent_when_the_route_is_found) {
+    fixture f;
+    mesh::message data(0x30, 4, 1, 9);
+    CHECK(f.router.on_unroutable(data));
+    CHECK_EQUAL(size_t(1), sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REQUEST, 5).size());
+    f.adapter.sent.clear();
+
+    f.route_to_9();
+    CHECK(f.adapter.sent.empty());
+    bool delivered = false;
+    for (const auto &report : f.adapter.reports) {
+        delivered |= report.type == 0x30 && report.next_hop == 5 && report.success;
+    }
+    CHECK(delivered);
+}
+
+TEST(buffered_messages_wait_for_room_in_the_transmit_queue) {
+    fixture f;
+    mesh::message data(0x30, 4, 1, 9);
+    CHECK(f.router.on_unroutable(data));
+
+    // Fill the transmit queue with messages that don't finish
+    f.adapter.results.assign(100, mesh::TRANSMIT_PENDING);
+    for (size_t i = 0; i < mesh::connectivity_adapter::class_queue_size; i++) {
+        mesh::message other(0x31, 0, 1, 6);
+        CHECK(f.adapter.send(other));
+    }
+    mesh::message reply = routing_message(AODV_ROUTING::ROUTE_REPLY, 5, {1, 9, 7, 2});
+    f.router.on_routing_message(reply);
+
+    f.adapter.results.clear();
+    f.adapter.drain();
+    f.adapter.sent.clear();
+    f.router.update();
+    f.adapter.drain();
+    CHECK_EQUAL(size_t(1), f.adapter.sent.size());
+    CHECK(f.adapter.sent.size() == 1 && f.adapter.sent[0].type() == 0x30 && f.adapter.sent[0].next_hop == 5);
+}
+
+TEST(discoveries_give_up_after_their_attempts) {
+    fixture f;
+    mesh::message data(0x30, 4, 1, 9);
+    CHECK(f.router.on_unroutable(data));
+
+    size_t ticks = 0;
+    for (uint8_t attempt = 0; attempt < aodv::max_discovery_attempts; attempt++) {
+        ticks += aodv::discovery_timeout << attempt;
+    }
+    for (size_t i = 0; i < ticks; i++) {
+        f.router.update();
+    }
+    CHECK_EQUAL(size_t(aodv::max_discovery_attempts), sent_payloads(f.adapter, AODV_ROUTING::ROUTE_REQUEST, 5).size());
+    f.adapter.sent.clear();
+
+    // The message was dropped, a later route doesn't send it
+    f.route_to_9();
+    f.router.update();
+    f.adapter.drain();
+    CHECK(f.adapter.sent.empty());
+}
+
+TEST(the_buffer_is_limited) {
+    fixture f;
+    mesh::message data(0x30, 4, 1, 9);
+    CHECK(f.router.on_unroutable(data));
+    CHECK(f.router.on_unroutable(data));
+    CHECK(!f.router.on_unroutable(data));
+}
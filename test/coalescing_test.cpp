@@ -0,0 +1,194 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include "test.hpp"
+#include "fake_adapter.hpp"
+
+using mesh_test::fake_adapter;
+
+namespace {
+    /// Serialized size of a message with a payload of size bytes
+    constexpr size_t message_size(size_t size) {
+        return mesh::message::header_size + size + mesh::message::connection_data_size;
+    }
+
+    mesh::message data_message(const mesh::node_id &receiver, uint8_t size, uint8_t fill,
+                               const mesh::message_type &type = 0x30) {
+        mesh::message msg(type, 0, 1, receiver);
+        msg.dataSize = size;
+        for (size_t i = 0; i < size; i++) {
+            msg.data[i] = uint8_t(fill + i);
+        }
+        return msg;
+    }
+
+    std::vector<uint8_t> bytes_of(mesh::message msg) {
+        std::vector<uint8_t> bytes(msg.size());
+        msg.to_byte_array(bytes.data());
+        return bytes;
+    }
+
+    bool view_equals(const mesh::message_view &view, const std::vector<uint8_t> &bytes) {
+        return view.is_valid() && view.size() == bytes.size() &&
+               std::equal(bytes.begin(), bytes.end(), view.begin());
+    }
+}
+
+TEST(small_messages_for_a_next_hop_are_bundled) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5};
+    adapter.enable_coalescing(message_size(4), 3);
+
+    mesh::message first = data_message(5, 2, 10);
+    mesh::message second = data_message(5, 1, 20, 0x31);
+    CHECK(adapter.send(first));
+    CHECK(adapter.send(second));
+    CHECK(adapter.sent.empty());
+
+    adapter.flush_coalesced(true);
+    CHECK_EQUAL(size_t(1), adapter.sent.size());
+    const auto &bundle = adapter.sent[0];
+    CHECK_EQUAL(mesh::node_id(5), bundle.next_hop);
+    CHECK_EQUAL(mesh::TRANSPORT::BUNDLE, bundle.type());
+    CHECK_EQUAL(mesh::node_id(5), bundle.receiver());
+
+    // Payload: size of the first message, the first message, size of the second message, the second message
+    std::vector<uint8_t> first_bytes = bytes_of(first);
+    std::vector<uint8_t> second_bytes = bytes_of(second);
+    const uint8_t *payload = bundle.bytes.data() + mesh::message::header_size;
+    CHECK_EQUAL(uint8_t(first_bytes.size() + second_bytes.size() + 2), bundle.bytes[5]);
+    CHECK_EQUAL(first_bytes.size(), size_t(payload[0]));
+    CHECK(std::equal(first_bytes.begin(), first_bytes.end(), payload + 1));
+    payload += 1 + first_bytes.size();
+    CHECK_EQUAL(second_bytes.size(), size_t(payload[0]));
+    CHECK(std::equal(second_bytes.begin(), second_bytes.end(), payload + 1));
+
+    // The receiving adapter returns the messages one by one
+    fake_adapter receiver(5);
+    receiver.frames.push_back(bundle.bytes);
+    CHECK(receiver.has_message());
+    CHECK(view_equals(receiver.next_message(), first_bytes));
+    CHECK(receiver.has_message());
+    CHECK(view_equals(receiver.next_message(), second_bytes));
+    CHECK(!receiver.has_message());
+}
+
+TEST(a_bundle_with_a_single_message_is_sent_as_that_message) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5};
+    adapter.enable_coalescing(message_size(4), 3);
+
+    mesh::message msg = data_message(5, 3, 1);
+    CHECK(adapter.send(msg));
+    adapter.flush_coalesced(true);
+    CHECK_EQUAL(size_t(1), adapter.sent.size());
+    CHECK(adapter.sent[0].bytes == bytes_of(msg));
+}
+
+TEST(bundles_are_sent_at_their_deadline) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5};
+    adapter.enable_coalescing(message_size(4), 2);
+
+    mesh::message msg = data_message(5, 1, 1);
+    CHECK(adapter.send(msg));
+    adapter.flush_coalesced();
+    CHECK(adapter.sent.empty());
+    adapter.flush_coalesced();
+    CHECK_EQUAL(size_t(1), adapter.sent.size());
+}
+
+TEST(a_full_bundle_is_sent_before_a_new_one_starts) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5};
+    adapter.enable_coalescing(message_size(4), 10);
+
+    // Two of these fit in a payload, with their size bytes
+    constexpr uint8_t size = 2;
+    static_assert(2 * (message_size(size) + 1) <= mesh::message::payload_size, "Two messages should fit");
+    static_assert(3 * (message_size(size) + 1) > mesh::message::payload_size, "Three messages shouldn't fit");
+
+    mesh::message first = data_message(5, size, 1);
+    mesh::message second = data_message(5, size, 2);
+    mesh::message third = data_message(5, size, 3);
+    CHECK(adapter.send(first));
+    CHECK(adapter.send(second));
+    CHECK(adapter.sent.empty());
+    CHECK(adapter.send(third));
+    CHECK_EQUAL(size_t(1), adapter.sent.size());
+    CHECK_EQUAL(mesh::TRANSPORT::BUNDLE, adapter.sent[0].type());
+    CHECK_EQUAL(size_t(2 * (message_size(size) + 1)), size_t(adapter.sent[0].bytes[5]));
+
+    adapter.drain();
+    adapter.flush_coalesced(true);
+    CHECK_EQUAL(size_t(2), adapter.sent.size());
+    CHECK(adapter.sent[1].bytes == bytes_of(third));
+}
+
+TEST(bundles_hold_a_single_next_hop_and_traffic_class) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5, 6};
+    adapter.enable_coalescing(message_size(4), 10);
+
+    mesh::message data_5 = data_message(5, 1, 1);
+    mesh::message routing_5 = data_message(5, 1, 2, mesh::LINK_STATE_ROUTING::UPDATE);
+    mesh::message data_6 = data_message(6, 1, 3);
+    mesh::message more_data_5 = data_message(5, 1, 4);
+    CHECK(adapter.send(data_5));
+    CHECK(adapter.send(routing_5));
+    CHECK(adapter.send(data_6));
+    CHECK(adapter.send(more_data_5));
+    adapter.flush_coalesced(true);
+    adapter.drain();
+
+    CHECK_EQUAL(size_t(3), adapter.sent.size());
+    size_t bundles = 0;
+    for (const auto &frame : adapter.sent) {
+        if (frame.type() == mesh::TRANSPORT::BUNDLE) {
+            bundles++;
+            CHECK_EQUAL(mesh::node_id(5), frame.next_hop);
+            CHECK_EQUAL(size_t(2 * (message_size(1) + 1)), size_t(frame.bytes[5]));
+        } else if (frame.type() == mesh::LINK_STATE_ROUTING::UPDATE) {
+            CHECK(frame.bytes == bytes_of(routing_5));
+        } else {
+            CHECK(frame.bytes == bytes_of(data_6));
+        }
+    }
+    CHECK_EQUAL(size_t(1), bundles);
+}
+
+TEST(large_and_discovery_messages_are_not_coalesced) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5};
+    adapter.enable_coalescing(message_size(4), 10);
+
+    mesh::message large = data_message(5, 5, 1);
+    CHECK(adapter.send(large));
+    CHECK_EQUAL(size_t(1), adapter.sent.size());
+
+    mesh::message accept = data_message(5, 0, 0, mesh::DISCOVERY::ACCEPT);
+    CHECK(adapter.send(accept));
+    adapter.drain();
+    CHECK_EQUAL(size_t(2), adapter.sent.size());
+}
+
+TEST(a_malformed_bundle_is_dropped) {
+    fake_adapter adapter(5);
+    mesh::message bundle(mesh::TRANSPORT::BUNDLE, 0, 1, 5);
+    std::vector<uint8_t> inner = bytes_of(data_message(5, 1, 1));
+    bundle.data[0] = uint8_t(inner.size() + 10); // Longer than the rest of the bundle
+    std::copy(inner.begin(), inner.end(), bundle.data.begin() + 1);
+    bundle.dataSize = uint8_t(inner.size() + 1);
+    adapter.receive(bundle);
+    mesh::message after = data_message(5, 1, 7);
+    adapter.receive(after);
+
+    CHECK(!adapter.next_message().is_valid());
+    CHECK(view_equals(adapter.next_message(), bytes_of(after)));
+}
@@ -0,0 +1,218 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include "test.hpp"
+#include "fake_adapter.hpp"
+#include <mesh/router/distance_vector_router.hpp>
+#include <algorithm>
+
+using mesh_test::fake_adapter;
+using mesh::routers::distance_vector;
+
+namespace {
+    constexpr uint8_t unit = mesh::connectivity_adapter::link_cost_unit;
+    constexpr uint8_t infinity = distance_vector::infinity;
+
+    struct entry {
+        mesh::node_id destination;
+        uint8_t sequence;
+        uint8_t metric;
+
+        bool operator==(const entry &other) const {
+            return destination == other.destination && sequence == other.sequence && metric == other.metric;
+        }
+    };
+
+    mesh::message update(const mesh::node_id &sender, std::initializer_list<entry> entries,
+                         const mesh::message_type &type = mesh::DISTANCE_VECTOR_ROUTING::UPDATE) {
+        mesh::message msg(type, 0, sender, 0);
+        for (const entry &e : entries) {
+            msg.data[msg.dataSize++] = e.destination;
+            msg.data[msg.dataSize++] = e.sequence;
+            msg.data[msg.dataSize++] = e.metric;
+        }
+        return msg;
+    }
+
+    /// Entries of all updates that were sent to a neighbour, and forget them
+    std::vector<entry> sent_entries(fake_adapter &adapter, const mesh::node_id &neighbour) {
+        adapter.drain();
+        std::vector<entry> entries;
+        for (const auto &frame : adapter.sent) {
+            if (frame.next_hop != neighbour) {
+                continue;
+            }
+            for (size_t i = 0; i + 3 <= frame.bytes[5]; i += 3) {
+                const uint8_t *data = frame.bytes.data() + mesh::message::header_size + i;
+                entries.push_back({data[0], data[1], data[2]});
+            }
+        }
+        adapter.sent.clear();
+        return entries;
+    }
+
+    bool contains(const std::vector<entry> &entries, const entry &e) {
+        return std::find(entries.begin(), entries.end(), e) != entries.end();
+    }
+
+    const distance_vector::route_entry *route_to(const distance_vector &router, const mesh::node_id &destination) {
+        for (size_t i = 0; i < router.get_table_size(); i++) {
+            if (router.get_route(i).destination == destination) {
+                return &router.get_route(i);
+            }
+        }
+        return nullptr;
+    }
+
+    /// Node 1, with neighbours 5 and 6, and a route to 9 through 5
+    struct fixture {
+        fake_adapter adapter{1};
+        mesh::routers::distance_vector_router<8> router{adapter};
+
+        fixture() {
+            adapter.neighbours = {5, 6};
+            router.initial_update();
+            mesh::message msg = update(5, {{5, 2, 0}, {9, 4, 10}});
+            router.on_routing_message(msg);
+            router.update();
+            adapter.drain();
+            adapter.sent.clear();
+        }
+    };
+}
+
+TEST(routes_add_the_link_cost_of_the_neighbour) {
+    fixture f;
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(5));
+    CHECK_EQUAL(mesh::node_id(6), f.router.get_next_hop(6));
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(9));
+    CHECK_EQUAL(uint8_t(unit), route_to(f.router, 5)->metric);
+    CHECK_EQUAL(uint8_t(10 + unit), route_to(f.router, 9)->metric);
+    CHECK_EQUAL(uint8_t(4), route_to(f.router, 9)->sequence);
+    CHECK_EQUAL(mesh::node_id(0), f.router.get_next_hop(10));
+
+    // Complete updates start with this node's own entry, with a new sequence number
+    f.router.send_update();
+    std::vector<entry> entries = sent_entries(f.adapter, 6);
+    CHECK(!entries.empty() && entries[0] == entry({1, 4, 0}));
+    CHECK(contains(entries, {9, 4, 10 + unit}));
+}
+
+TEST(newer_sequence_numbers_and_shorter_routes_are_taken_over) {
+    fixture f;
+    // Same sequence number, longer route
+    mesh::message msg = update(6, {{9, 4, 30}});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(9));
+
+    // Same sequence number, shorter route
+    msg = update(6, {{9, 4, 5}});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(6), f.router.get_next_hop(9));
+
+    // Newer sequence number, even though it is longer
+    msg = update(5, {{9, 6, 40}});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(9));
+    CHECK_EQUAL(uint8_t(6), route_to(f.router, 9)->sequence);
+
+    // The current next hop is always believed
+    msg = update(5, {{9, 6, 80}});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(9));
+    CHECK_EQUAL(uint8_t(80 + unit), route_to(f.router, 9)->metric);
+}
+
+TEST(sequence_numbers_wrap_around) {
+    fixture f;
+    mesh::message msg = update(5, {{9, 254, 10}});
+    f.router.on_routing_message(msg);
+    msg = update(6, {{9, 0, 50}});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(6), f.router.get_next_hop(9));
+    CHECK_EQUAL(uint8_t(0), route_to(f.router, 9)->sequence);
+}
+
+TEST(losing_a_neighbour_makes_its_routes_infinite) {
+    fixture f;
+    f.adapter.neighbours = {6};
+    CHECK(f.router.update_neighbours());
+    CHECK_EQUAL(mesh::node_id(0), f.router.get_next_hop(5));
+    CHECK_EQUAL(mesh::node_id(0), f.router.get_next_hop(9));
+    CHECK_EQUAL(mesh::node_id(6), f.router.get_next_hop(6));
+
+    // Broken routes get an odd sequence number, one newer than the route
+    f.router.update();
+    std::vector<entry> entries = sent_entries(f.adapter, 6);
+    CHECK(contains(entries, {9, 5, infinity}));
+    CHECK(contains(entries, {5, 3, infinity}));
+
+    // An older route can't come back through another neighbour
+    mesh::message msg = update(6, {{9, 4, 20}});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(0), f.router.get_next_hop(9));
+    // A route based on a newer sequence number from the destination can
+    msg = update(6, {{9, 6, 20}});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(6), f.router.get_next_hop(9));
+}
+
+TEST(metrics_that_reach_infinity_are_unreachable) {
+    fixture f;
+    mesh::message msg = update(5, {{9, 6, infinity - unit}, {10, 2, infinity - unit}, {11, 2, infinity - unit - 1}});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(0), f.router.get_next_hop(9));
+    CHECK_EQUAL(infinity, route_to(f.router, 9)->metric);
+    // Unreachable destinations aren't added to the table
+    CHECK(route_to(f.router, 10) == nullptr);
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(11));
+}
+
+TEST(stale_neighbours_are_sent_the_newer_route) {
+    fixture f;
+    mesh::message msg = update(6, {{9, 2, 10}});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(5), f.router.get_next_hop(9));
+    f.router.update();
+    CHECK(contains(sent_entries(f.adapter, 6), {9, 4, 10 + unit}));
+}
+
+TEST(a_newer_route_to_this_node_increases_its_sequence_number) {
+    fixture f;
+    // An echo of the current sequence number changes nothing
+    mesh::message msg = update(5, {{1, 2, 10}});
+    f.router.on_routing_message(msg);
+    f.router.update();
+    CHECK(sent_entries(f.adapter, 5).empty());
+
+    // A broken route to this node is replaced by a newer even sequence number
+    msg = update(5, {{1, 3, infinity}});
+    f.router.on_routing_message(msg);
+    f.router.update();
+    std::vector<entry> entries = sent_entries(f.adapter, 5);
+    CHECK(!entries.empty() && entries[0] == entry({1, 4, 0}));
+}
+
+TEST(only_neighbours_are_listened_to) {
+    fixture f;
+    mesh::message msg = update(7, {{7, 2, 0}, {12, 2, 10}});
+    f.router.on_routing_message(msg);
+    CHECK_EQUAL(mesh::node_id(0), f.router.get_next_hop(7));
+    CHECK_EQUAL(mesh::node_id(0), f.router.get_next_hop(12));
+}
+
+TEST(update_requests_are_answered_with_all_routes) {
+    fixture f;
+    mesh::message msg = update(6, {{6, 2, 0}}, mesh::DISTANCE_VECTOR_ROUTING::UPDATE_REQUEST);
+    f.router.on_routing_message(msg);
+    std::vector<entry> entries = sent_entries(f.adapter, 6);
+    CHECK(!entries.empty() && entries[0] == entry({1, 4, 0}));
+    CHECK(contains(entries, {5, 2, unit}));
+    CHECK(contains(entries, {9, 4, 10 + unit}));
+}
@@ -0,0 +1,107 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include "test.hpp"
+#include "fake_adapter.hpp"
+
+using mesh_test::fake_adapter;
+
+namespace {
+    bool is_new(fake_adapter &adapter, const mesh::node_id &sender, uint8_t message_id) {
+        mesh::message msg(0x30, message_id, sender, 1);
+        uint8_t bytes[mesh::message::payload_size];
+        msg.to_byte_array(bytes);
+        return adapter.is_new_message({bytes, msg.size()});
+    }
+}
+
+TEST(repeated_messages_are_duplicates) {
+    fake_adapter adapter(1);
+    CHECK(is_new(adapter, 5, 10));
+    CHECK(!is_new(adapter, 5, 10));
+    CHECK(is_new(adapter, 5, 11));
+    CHECK(!is_new(adapter, 5, 11));
+    // Every sender has its own id's
+    CHECK(is_new(adapter, 6, 10));
+}
+
+TEST(message_ids_wrap_around) {
+    fake_adapter adapter(1);
+    CHECK(is_new(adapter, 5, 254));
+    CHECK(is_new(adapter, 5, 255));
+    CHECK(is_new(adapter, 5, 0));
+    CHECK(is_new(adapter, 5, 1));
+    CHECK(!is_new(adapter, 5, 255));
+    CHECK(!is_new(adapter, 5, 0));
+    CHECK(!is_new(adapter, 5, 254));
+}
+
+TEST(late_messages_within_the_window_are_accepted_once) {
+    fake_adapter adapter(1);
+    CHECK(is_new(adapter, 5, 10));
+    CHECK(is_new(adapter, 5, 14));
+    CHECK(is_new(adapter, 5, 12));
+    CHECK(!is_new(adapter, 5, 12));
+    CHECK(!is_new(adapter, 5, 10));
+    CHECK(is_new(adapter, 5, 11));
+    CHECK(!is_new(adapter, 5, 11));
+
+    // Still within the window after a jump across the wraparound
+    CHECK(is_new(adapter, 5, 40));
+    CHECK(!is_new(adapter, 5, 14));
+    CHECK(is_new(adapter, 5, 13));
+}
+
+TEST(messages_behind_the_window_are_from_a_restarted_sender) {
+    fake_adapter adapter(1);
+    adapter.set_duplicate_window(8);
+    CHECK(is_new(adapter, 5, 100));
+    CHECK(is_new(adapter, 5, 101));
+    CHECK(is_new(adapter, 6, 0));
+    CHECK(is_new(adapter, 6, 1));
+
+    // The sender restarted, its id's start over
+    CHECK(is_new(adapter, 5, 0));
+    CHECK(is_new(adapter, 5, 1));
+    CHECK(!is_new(adapter, 5, 1));
+    CHECK(!is_new(adapter, 5, 0));
+
+    // A restart that lands within the window can't be told apart from late duplicates, until its id's pass the old ones
+    CHECK(!is_new(adapter, 6, 0));
+    CHECK(!is_new(adapter, 6, 1));
+    CHECK(is_new(adapter, 6, 2));
+}
+
+TEST(forgetting_a_sender_accepts_its_ids_again) {
+    fake_adapter adapter(1);
+    CHECK(is_new(adapter, 5, 3));
+    CHECK(is_new(adapter, 6, 3));
+    adapter.forget_message_history_for(5);
+    CHECK(is_new(adapter, 5, 3));
+    CHECK(!is_new(adapter, 6, 3));
+    // Forgetting an unknown sender does nothing
+    adapter.forget_message_history_for(7);
+    CHECK(!is_new(adapter, 5, 3));
+}
+
+TEST(duplicate_window_size_is_limited) {
+    fake_adapter adapter(1);
+    adapter.set_duplicate_window(0);
+    CHECK(is_new(adapter, 5, 10));
+    // A window of one only remembers the newest id, so anything older is a restart
+    CHECK(is_new(adapter, 5, 9));
+    CHECK(!is_new(adapter, 5, 9));
+
+    adapter.set_duplicate_window(200);
+    CHECK(is_new(adapter, 6, 100));
+    CHECK(is_new(adapter, 6, 131));
+    CHECK(!is_new(adapter, 6, 100));
+    // 32 behind the newest id is outside the largest window
+    CHECK(is_new(adapter, 6, 99));
+}
@@ -0,0 +1,162 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_MESH_TEST_FAKE_ADAPTER_HPP
+#define IPASS_MESH_TEST_FAKE_ADAPTER_HPP
+
+#include <mesh/connectivity_adapter.hpp>
+#include <deque>
+#include <set>
+#include <vector>
+
+namespace mesh_test {
+    /**
+     * \brief Connectivity adapter that records transmissions, and lets a test choose their results
+     *
+     * Every start_transmit is recorded in sent. poll_transmit reports the front of results. When it is empty, transmissions
+     * to an unreachable next hop fail, and all others succeed.
+     * Frames pushed to frames are received in order. Transmit results are recorded in reports.
+     */
+    class fake_adapter : public mesh::connectivity_adapter, public mesh::transmit_listener {
+    public:
+        struct transmission {
+            mesh::node_id next_hop;
+            std::vector<uint8_t> bytes;
+
+            mesh::message_type type() const {
+                return bytes[0];
+            }
+
+            /// Receiver field of the transmitted message
+            mesh::node_id receiver() const {
+                return bytes[3];
+            }
+        };
+
+        struct report {
+            mesh::node_id next_hop;
+            mesh::message_type type;
+            bool success;
+        };
+
+        /// Accepted neighbours, every other node is disconnected
+        std::set<mesh::node_id> neighbours;
+        std::vector<transmission> sent;
+        std::deque<mesh::transmit_status> results;
+        std::set<mesh::node_id> unreachable;
+        std::vector<report> reports;
+        std::deque<std::vector<uint8_t>> frames;
+        size_t window = 1;
+
+        explicit fake_adapter(mesh::node_id address) : connectivity_adapter(address) {
+            set_transmit_listener(*this);
+        }
+
+        /**
+         * \brief Poll the transmit queue until nothing is left, or max_polls is reached
+         * @param max_polls Maximum amount of polls
+         */
+        void drain(size_t max_polls = 100) {
+            for (size_t i = 0; i < max_polls && is_transmitting(); i++) {
+                poll();
+            }
+        }
+
+        /**
+         * \brief Add a message to the frames to receive
+         * @param msg Message to receive
+         */
+        void receive(mesh::message msg) {
+            std::vector<uint8_t> bytes(msg.size());
+            msg.to_byte_array(bytes.data());
+            frames.push_back(bytes);
+        }
+
+        void on_transmit_complete(const mesh::node_id &next_hop, const mesh::message_type &type, bool success) override {
+            reports.push_back({next_hop, type, success});
+        }
+
+        mesh::mesh_connection_state connection_state(const mesh::node_id &id) override {
+            return neighbours.count(id) ? mesh::ACCEPTED : mesh::DISCONNECTED;
+        }
+
+        size_t get_neighbour_count() override {
+            return neighbours.size();
+        }
+
+        void get_neighbours(uint8_t data[]) override {
+            size_t i = 0;
+            for (mesh::node_id neighbour : neighbours) {
+                data[i++] = neighbour;
+            }
+        }
+
+        bool discovery_present_received(mesh::message &) override {
+            return false;
+        }
+
+        bool discovery_respond_received(mesh::message &) override {
+            return false;
+        }
+
+        void discovery_accept_received(mesh::message &) override {}
+
+        void remove_direct_connection(const uint8_t &) override {}
+
+        void status() override {}
+
+    protected:
+        bool start_transmit(mesh::node_id &id, uint8_t *data, size_t size) override {
+            sent.push_back({id, std::vector<uint8_t>(data, data + size)});
+            in_flight_hops.push_back(id);
+            return true;
+        }
+
+        mesh::transmit_status poll_transmit() override {
+            mesh::transmit_status status = mesh::TRANSMIT_SUCCESS;
+            if (!results.empty()) {
+                status = results.front();
+                results.pop_front();
+            } else if (!in_flight_hops.empty() && unreachable.count(in_flight_hops.front())) {
+                status = mesh::TRANSMIT_FAILED;
+            }
+            if (status == mesh::TRANSMIT_FAILED) { // Like a radio, the transmissions after a failed one are cancelled
+                in_flight_hops.clear();
+            } else if (status == mesh::TRANSMIT_SUCCESS && !in_flight_hops.empty()) {
+                in_flight_hops.pop_front();
+            }
+            return status;
+        }
+
+        size_t transmit_window() override {
+            return window;
+        }
+
+        bool has_frame() override {
+            return !frames.empty();
+        }
+
+        mesh::message_view next_frame() override {
+            if (frames.empty()) {
+                return {};
+            }
+            current = frames.front();
+            frames.pop_front();
+            return {current.data(), current.size()};
+        }
+
+    private:
+        /// Frame returned by the last next_frame
+        std::vector<uint8_t> current;
+        /// Next hops of the transmissions in flight, oldest first
+        std::deque<mesh::node_id> in_flight_hops;
+    };
+}
+
+#endif //IPASS_MESH_TEST_FAKE_ADAPTER_HPP
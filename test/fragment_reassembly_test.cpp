@@ -0,0 +1,164 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include "test.hpp"
+#include <mesh/fragment_reassembly.hpp>
+
+namespace {
+    /// Three fragments: two full ones, and a last one of 10 bytes
+    constexpr size_t payload_size = 2 * mesh::fragment_reassembly::fragment_data_size + 10;
+
+    struct payload {
+        uint8_t bytes[payload_size];
+
+        explicit payload(uint8_t seed) {
+            for (size_t i = 0; i < payload_size; i++) {
+                bytes[i] = uint8_t(seed + i);
+            }
+        }
+    };
+
+    mesh::message fragment(const mesh::node_id &sender, uint8_t transfer_id, uint8_t index, const payload &data) {
+        mesh::message msg(mesh::TRANSPORT::FRAGMENT, 0, sender, 1);
+        mesh::fragment_reassembly::fill_fragment(msg, 0x40, transfer_id, index, data.bytes, payload_size);
+        return msg;
+    }
+
+    bool same_payload(const mesh::fragment_reassembly::reassembly_buffer *buffer, const payload &data) {
+        if (buffer == nullptr || buffer->size != payload_size) {
+            return false;
+        }
+        for (size_t i = 0; i < payload_size; i++) {
+            if (buffer->data[i] != data.bytes[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+TEST(fragments_out_of_order_are_reassembled) {
+    mesh::fragment_pool<2, 64> pool;
+    payload data(7);
+    CHECK_EQUAL(size_t(3), mesh::fragment_reassembly::fragment_count(payload_size));
+
+    CHECK(pool.add_fragment(fragment(5, 1, 2, data)));
+    CHECK(pool.add_fragment(fragment(5, 1, 0, data)));
+    CHECK(pool.next_completed() == nullptr);
+    CHECK(pool.add_fragment(fragment(5, 1, 1, data)));
+
+    const auto *completed = pool.next_completed();
+    CHECK(same_payload(completed, data));
+    CHECK_EQUAL(mesh::message_type(0x40), completed->type);
+    CHECK_EQUAL(mesh::node_id(5), completed->sender);
+    pool.release(completed);
+    CHECK(pool.next_completed() == nullptr);
+}
+
+TEST(duplicate_fragments_are_ignored) {
+    mesh::fragment_pool<2, 64> pool;
+    payload data(3);
+    payload other(100);
+
+    CHECK(pool.add_fragment(fragment(5, 1, 0, data)));
+    // A duplicate is accepted, but doesn't count or overwrite the first copy
+    CHECK(pool.add_fragment(fragment(5, 1, 0, other)));
+    CHECK(pool.add_fragment(fragment(5, 1, 1, data)));
+    CHECK(pool.next_completed() == nullptr);
+    CHECK(pool.add_fragment(fragment(5, 1, 2, data)));
+
+    const auto *completed = pool.next_completed();
+    CHECK(same_payload(completed, data));
+    CHECK_EQUAL(uint8_t(3), completed->received_count);
+    // Duplicates after completion leave the payload alone
+    CHECK(pool.add_fragment(fragment(5, 1, 1, other)));
+    CHECK(same_payload(pool.next_completed(), data));
+}
+
+TEST(unfinished_transfers_time_out) {
+    mesh::fragment_pool<1, 64> pool(1, 3);
+    payload data(9);
+
+    CHECK(pool.add_fragment(fragment(5, 1, 0, data)));
+    pool.tick();
+    pool.tick();
+    // A new fragment restarts the timeout
+    CHECK(pool.add_fragment(fragment(5, 1, 1, data)));
+    pool.tick();
+    pool.tick();
+    pool.tick();
+
+    // The buffer was freed, so the last fragment starts a new transfer that misses the first two
+    CHECK(pool.add_fragment(fragment(5, 1, 2, data)));
+    CHECK(pool.next_completed() == nullptr);
+    CHECK(pool.add_fragment(fragment(5, 1, 0, data)));
+    CHECK(pool.add_fragment(fragment(5, 1, 1, data)));
+    CHECK(same_payload(pool.next_completed(), data));
+}
+
+TEST(completed_payloads_that_are_not_read_time_out) {
+    mesh::fragment_pool<1, 64> pool(1, 2);
+    payload data(1);
+    for (uint8_t i = 0; i < 3; i++) {
+        CHECK(pool.add_fragment(fragment(5, 1, i, data)));
+    }
+    CHECK(pool.next_completed() != nullptr);
+    pool.tick();
+    pool.tick();
+    CHECK(pool.next_completed() == nullptr);
+}
+
+TEST(a_sender_can_only_use_its_share_of_buffers) {
+    mesh::fragment_pool<3, 64> pool(1);
+    payload data(5);
+
+    CHECK(pool.add_fragment(fragment(5, 1, 0, data)));
+    CHECK(!pool.add_fragment(fragment(5, 2, 0, data)));
+    // Other senders still get a buffer
+    CHECK(pool.add_fragment(fragment(6, 1, 0, data)));
+
+    // Once the first transfer is read, the sender can start a new one
+    CHECK(pool.add_fragment(fragment(5, 1, 1, data)));
+    CHECK(pool.add_fragment(fragment(5, 1, 2, data)));
+    const auto *completed = pool.next_completed();
+    CHECK(same_payload(completed, data));
+    pool.release(completed);
+    CHECK(pool.add_fragment(fragment(5, 2, 0, data)));
+}
+
+TEST(all_buffers_in_use_rejects_new_transfers) {
+    mesh::fragment_pool<2, 64> pool(2);
+    payload data(5);
+
+    CHECK(pool.add_fragment(fragment(5, 1, 0, data)));
+    CHECK(pool.add_fragment(fragment(6, 1, 0, data)));
+    CHECK(!pool.add_fragment(fragment(7, 1, 0, data)));
+    // Transfers that already have a buffer continue
+    CHECK(pool.add_fragment(fragment(5, 1, 1, data)));
+}
+
+TEST(invalid_fragments_are_rejected) {
+    mesh::fragment_pool<1, 32> pool;
+    payload data(5);
+
+    // The payload doesn't fit in a 32 byte buffer
+    CHECK(!pool.add_fragment(fragment(5, 1, 2, data)));
+
+    mesh::message msg = fragment(5, 1, 0, data);
+    msg.data[2] = msg.data[3]; // Index beyond the fragment count
+    CHECK(!pool.add_fragment(msg));
+
+    msg = fragment(5, 1, 0, data);
+    msg.dataSize--; // Only the last fragment can be short
+    CHECK(!pool.add_fragment(msg));
+
+    msg.dataSize = mesh::fragment_reassembly::header_size - 1;
+    CHECK(!pool.add_fragment(msg));
+    CHECK(pool.next_completed() == nullptr);
+}
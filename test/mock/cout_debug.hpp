@@ -0,0 +1,17 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_MESH_TEST_MOCK_COUT_DEBUG_HPP
+#define IPASS_MESH_TEST_MOCK_COUT_DEBUG_HPP
+
+#include <hwlib.hpp>
+
+#define LOG(a, b) (hwlib::cout << a << b)
+
+#endif //IPASS_MESH_TEST_MOCK_COUT_DEBUG_HPP
@@ -0,0 +1,60 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_MESH_TEST_MOCK_HWLIB_HPP
+#define IPASS_MESH_TEST_MOCK_HWLIB_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * \brief The parts of HWLib the library uses, for building it on the host
+ *
+ * Output is discarded, and time only passes when a test sets mock::time_us.
+ */
+namespace hwlib {
+    struct ostream {
+        template<typename T>
+        ostream &operator<<(const T &) {
+            return *this;
+        }
+    };
+
+    struct manipulator {
+    };
+
+    inline ostream cout;
+    inline manipulator hex, dec, bin, endl, flush;
+
+    namespace mock {
+        /// Current time, as returned by now_us
+        inline uint_fast64_t time_us = 0;
+    }
+
+    inline uint_fast64_t now_us() {
+        return mock::time_us;
+    }
+
+    inline void wait_us(int_fast32_t n) {
+        mock::time_us += n;
+    }
+
+    inline void wait_ms(int_fast32_t n) {
+        mock::time_us += uint_fast64_t(n) * 1000;
+    }
+
+    class pin_in {
+    public:
+        virtual bool read() = 0;
+
+        virtual void refresh() {}
+    };
+}
+
+#endif //IPASS_MESH_TEST_MOCK_HWLIB_HPP
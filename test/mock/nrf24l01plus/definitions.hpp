@@ -0,0 +1,84 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_MESH_TEST_MOCK_NRF24L01PLUS_DEFINITIONS_HPP
+#define IPASS_MESH_TEST_MOCK_NRF24L01PLUS_DEFINITIONS_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * \brief Register definitions of cpp_nrf24l01, as far as the library uses them
+ */
+namespace nrf24l01 {
+    struct address {
+        uint8_t address_bytes[5] = {0};
+
+        address() = default;
+
+        address(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t e) : address_bytes{a, b, c, d, e} {}
+
+        /// Copy of base, with a different last byte
+        address(const address &base, uint8_t last) : address(base) {
+            address_bytes[4] = last;
+        }
+
+        bool operator==(const address &other) const {
+            for (size_t i = 0; i < 5; i++) {
+                if (address_bytes[i] != other.address_bytes[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        bool operator!=(const address &other) const {
+            return !(*this == other);
+        }
+    };
+
+    enum NRF_REGISTER : uint8_t {
+        CONFIG = 0x00,
+        EN_AA = 0x01,
+        EN_RXADDR = 0x02,
+        SETUP_AW = 0x03,
+        SETUP_RETR = 0x04,
+        RF_CH = 0x05,
+        RF_SETUP = 0x06,
+        NRF_STATUS = 0x07,
+        OBSERVE_TX = 0x08,
+        RX_ADDR_P0 = 0x0A,
+        TX_ADDR = 0x10,
+        FIFO_STATUS = 0x17,
+        DYNPD = 0x1C,
+        FEATURE = 0x1D
+    };
+
+    struct NRF_STATUS {
+        static constexpr const uint8_t RX_DR = 0x40;
+        static constexpr const uint8_t TX_DS = 0x20;
+        static constexpr const uint8_t MAX_RT = 0x10;
+        static constexpr const uint8_t TX_FULL = 0x01;
+    };
+
+    struct NRF_FIFO_STATUS {
+        static constexpr const uint8_t TX_FULL = 0x20;
+        static constexpr const uint8_t TX_EMPTY = 0x10;
+        static constexpr const uint8_t RX_FULL = 0x02;
+        static constexpr const uint8_t RX_EMPTY = 0x01;
+    };
+
+    struct NRF_FEATURE {
+        static constexpr const uint8_t EN_DPL = 0x04;
+        static constexpr const uint8_t EN_ACK_PAY = 0x02;
+        static constexpr const uint8_t EN_DYN_ACK = 0x01;
+    };
+}
+
+#endif //IPASS_MESH_TEST_MOCK_NRF24L01PLUS_DEFINITIONS_HPP
@@ -0,0 +1,238 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_MESH_TEST_MOCK_NRF24L01PLUS_HPP
+#define IPASS_MESH_TEST_MOCK_NRF24L01PLUS_HPP
+
+#include <hwlib.hpp>
+#include <nrf24l01plus/definitions.hpp>
+#include <array>
+#include <deque>
+#include <vector>
+
+namespace nrf24l01 {
+    inline hwlib::ostream &operator<<(hwlib::ostream &os, const address &) {
+        return os;
+    }
+
+    /**
+     * \brief Register level model of an NRF24L01+ module, with the interface of cpp_nrf24l01
+     *
+     * Models the parts of the module the connectivity adapter depends on:
+     * - A 3-deep TX FIFO. Writing a payload to a full FIFO loses it, these writes are counted in lost_payloads.
+     * - STATUS flags that are cleared by writing a 1 to them.
+     * - Payloads that are acknowledged leave the FIFO and set TX_DS, a single flag for any amount of payloads.
+     * - A payload that reaches MAX_RT stays in the FIFO, and stops transmission until MAX_RT is cleared.
+     * - The retransmit count of the last payload in OBSERVE_TX.
+     *
+     * Nothing happens on the air by itself, tests call transmit and fail to let the module progress.
+     */
+    class nrf24l01plus {
+    public:
+        static constexpr const uint8_t MODE_NONE = 0;
+        static constexpr const uint8_t MODE_PTX = 1;
+        static constexpr const uint8_t MODE_PRX = 2;
+        static constexpr const size_t fifo_size = 3;
+
+        /// STATUS register, as read by the last command
+        uint8_t last_status = 0;
+
+        /// Payloads in the TX FIFO, oldest first
+        std::deque<std::vector<uint8_t>> tx_fifo;
+        /// Payloads in the RX FIFO, oldest first
+        std::deque<std::vector<uint8_t>> rx_fifo;
+        /// Payloads that were acknowledged by their receiver, in order
+        std::vector<std::vector<uint8_t>> delivered;
+        /// Payloads written while the TX FIFO was full
+        size_t lost_payloads = 0;
+        /// Largest amount of payloads that were in the TX FIFO at once
+        size_t max_tx_occupancy = 0;
+        std::array<uint8_t, 0x20> registers = {0};
+        std::array<address, 6> rx_addresses = {};
+        address tx_address = {};
+        uint8_t current_mode = MODE_NONE;
+
+        /**
+         * \brief Let the module deliver payloads from the TX FIFO
+         *
+         * Does nothing while MAX_RT is set, like the module.
+         * @param count Maximum amount of payloads to deliver
+         * @param retransmits Retransmits each payload needed, reported in OBSERVE_TX
+         */
+        void transmit(size_t count, uint8_t retransmits = 0) {
+            for (size_t i = 0; i < count && !tx_fifo.empty() && (status & NRF_STATUS::MAX_RT) == 0; i++) {
+                delivered.push_back(tx_fifo.front());
+                tx_fifo.pop_front();
+                status |= NRF_STATUS::TX_DS;
+                observe_tx(retransmits);
+            }
+        }
+
+        /**
+         * \brief Let the payload at the front of the TX FIFO run out of retransmits
+         *
+         * The payload stays in the FIFO, and MAX_RT is set.
+         */
+        void fail() {
+            if (tx_fifo.empty()) {
+                return;
+            }
+            status |= NRF_STATUS::MAX_RT;
+            observe_tx(registers[SETUP_RETR] & 0x0F);
+        }
+
+        /**
+         * \brief Let the module receive a payload
+         * @return False if the RX FIFO is full, and the payload is lost
+         */
+        bool receive(const std::vector<uint8_t> &payload) {
+            if (rx_fifo.size() >= fifo_size) {
+                return false;
+            }
+            rx_fifo.push_back(payload);
+            status |= NRF_STATUS::RX_DR;
+            return true;
+        }
+
+        void write_register(uint8_t reg, uint8_t value) {
+            if (reg == NRF_STATUS) {
+                status &= uint8_t(~(value & (NRF_STATUS::RX_DR | NRF_STATUS::TX_DS | NRF_STATUS::MAX_RT)));
+            } else if (reg != FIFO_STATUS && reg != OBSERVE_TX) {
+                registers[reg] = value;
+            }
+            update_status();
+        }
+
+        void read_register(uint8_t reg, uint8_t *value, uint8_t n = 1) {
+            for (uint8_t i = 0; i < n; i++) {
+                value[i] = reg == NRF_STATUS ? current_status() : reg == FIFO_STATUS ? fifo_status() : registers[reg];
+            }
+            update_status();
+        }
+
+        void rx_auto_acknowledgement(bool enabled) {
+            registers[EN_AA] = enabled ? 0x3F : 0x00;
+            update_status();
+        }
+
+        void rx_set_dynamic_payload_length(bool enabled) {
+            registers[DYNPD] = enabled ? 0x3F : 0x00;
+            update_status();
+        }
+
+        void mode(uint8_t new_mode) {
+            current_mode = new_mode;
+            update_status();
+        }
+
+        uint8_t get_mode() {
+            update_status();
+            return current_mode;
+        }
+
+        void rx_enabled(uint8_t pipe, bool enabled) {
+            if (enabled) {
+                registers[EN_RXADDR] |= uint8_t(1 << pipe);
+            } else {
+                registers[EN_RXADDR] &= uint8_t(~(1 << pipe));
+            }
+            update_status();
+        }
+
+        void rx_set_address(uint8_t pipe, const address &rx_address) {
+            rx_addresses[pipe] = rx_address;
+            update_status();
+        }
+
+        void tx_set_address(const address &new_address) {
+            tx_address = new_address;
+            update_status();
+        }
+
+        address rx_get_address(uint8_t pipe) {
+            update_status();
+            return rx_addresses[pipe];
+        }
+
+        address tx_get_address() {
+            update_status();
+            return tx_address;
+        }
+
+        void tx_flush() {
+            tx_fifo.clear();
+            update_status();
+        }
+
+        void rx_flush() {
+            rx_fifo.clear();
+            update_status();
+        }
+
+        void tx_write_payload(const uint8_t *data, uint8_t n, bool) {
+            if (tx_fifo.size() >= fifo_size) {
+                lost_payloads++;
+            } else {
+                tx_fifo.emplace_back(data, data + n);
+                if (tx_fifo.size() > max_tx_occupancy) {
+                    max_tx_occupancy = tx_fifo.size();
+                }
+            }
+            update_status();
+        }
+
+        void no_operation() {
+            update_status();
+        }
+
+        uint8_t fifo_status() {
+            update_status();
+            return uint8_t((tx_fifo.size() >= fifo_size ? NRF_FIFO_STATUS::TX_FULL : 0) |
+                           (tx_fifo.empty() ? NRF_FIFO_STATUS::TX_EMPTY : 0) |
+                           (rx_fifo.size() >= fifo_size ? NRF_FIFO_STATUS::RX_FULL : 0) |
+                           (rx_fifo.empty() ? NRF_FIFO_STATUS::RX_EMPTY : 0));
+        }
+
+        uint8_t rx_payload_width() {
+            update_status();
+            return rx_fifo.empty() ? 0 : uint8_t(rx_fifo.front().size());
+        }
+
+        void rx_read_payload(uint8_t *data, uint8_t n) {
+            if (!rx_fifo.empty()) {
+                for (size_t i = 0; i < n && i < rx_fifo.front().size(); i++) {
+                    data[i] = rx_fifo.front()[i];
+                }
+                rx_fifo.pop_front();
+            }
+            update_status();
+        }
+
+    private:
+        /// RX_DR, TX_DS and MAX_RT, the other STATUS bits follow from the FIFO's
+        uint8_t status = 0;
+
+        uint8_t current_status() const {
+            // RX_P_NO is 0b111 when the RX FIFO is empty, all payloads are reported on pipe 0 otherwise
+            return uint8_t(status | (rx_fifo.empty() ? 0x0E : 0x00) |
+                           (tx_fifo.size() >= fifo_size ? NRF_STATUS::TX_FULL : 0));
+        }
+
+        /// Every SPI command shifts out the STATUS register
+        void update_status() {
+            last_status = current_status();
+        }
+
+        void observe_tx(uint8_t retransmits) {
+            registers[OBSERVE_TX] = uint8_t((registers[OBSERVE_TX] & 0xF0) | (retransmits & 0x0F));
+        }
+    };
+}
+
+#endif //IPASS_MESH_TEST_MOCK_NRF24L01PLUS_HPP
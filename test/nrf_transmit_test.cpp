@@ -0,0 +1,170 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include "test.hpp"
+#include <mesh/connectivity/nrf.hpp>
+
+namespace {
+    /// NRF adapter with its transmit steps exposed
+    class test_nrf : public mesh::connectivity::nrf {
+    public:
+        using nrf::nrf;
+        using nrf::start_transmit;
+        using nrf::poll_transmit;
+        using nrf::transmit_window;
+        using nrf::transmit_attempts;
+    };
+
+    /// Radio with an adapter that has a pipe for node 5
+    struct fixture {
+        nrf24l01::nrf24l01plus radio;
+        mesh::spsc_ring_buffer<mesh::connectivity::nrf_frame, 4> buffer;
+        test_nrf adapter{1, radio, buffer};
+
+        fixture() {
+            hwlib::mock::time_us = 0;
+            mesh::message present(mesh::DISCOVERY::PRESENT, 0, 5, 0);
+            present.connectionData[0] = 3;
+            adapter.discovery_present_received(present);
+        }
+
+        /// Start sending a payload to node 5, the payload is only the id byte
+        bool start(uint8_t payload_id, mesh::node_id next_hop = 5) {
+            uint8_t data[1] = {payload_id};
+            return adapter.start_transmit(next_hop, data, sizeof(data));
+        }
+
+        /// Id's of the payloads the radio delivered
+        std::vector<uint8_t> delivered() const {
+            std::vector<uint8_t> ids;
+            for (const auto &payload : radio.delivered) {
+                ids.push_back(payload[0]);
+            }
+            return ids;
+        }
+    };
+}
+
+TEST(the_tx_fifo_is_never_filled) {
+    fixture f;
+    CHECK_EQUAL(size_t(2), f.adapter.transmit_window());
+    CHECK(!f.start(1, 7)); // No pipe for this node
+    CHECK(f.start(1));
+    CHECK(f.start(2));
+    CHECK(!f.start(3));
+    CHECK_EQUAL(size_t(2), f.radio.tx_fifo.size());
+    CHECK((f.radio.fifo_status() & nrf24l01::NRF_FIFO_STATUS::TX_FULL) == 0);
+
+    // A payload is appended as soon as an earlier one is reported
+    f.radio.transmit(1);
+    CHECK_EQUAL(mesh::TRANSMIT_SUCCESS, f.adapter.poll_transmit());
+    CHECK(f.start(3));
+    CHECK(!f.start(4));
+    f.radio.transmit(2);
+    CHECK_EQUAL(mesh::TRANSMIT_SUCCESS, f.adapter.poll_transmit());
+    CHECK_EQUAL(mesh::TRANSMIT_SUCCESS, f.adapter.poll_transmit());
+    CHECK(f.delivered() == std::vector<uint8_t>({1, 2, 3}));
+    CHECK_EQUAL(size_t(2), f.radio.max_tx_occupancy);
+    CHECK_EQUAL(size_t(0), f.radio.lost_payloads);
+}
+
+TEST(several_payloads_are_reported_for_a_single_tx_ds) {
+    fixture f;
+    CHECK(f.start(1));
+    CHECK(f.start(2));
+    CHECK_EQUAL(mesh::TRANSMIT_PENDING, f.adapter.poll_transmit());
+
+    // Both payloads are sent before the next poll, which only sets TX_DS once
+    f.radio.transmit(2, 2);
+    CHECK_EQUAL(mesh::TRANSMIT_SUCCESS, f.adapter.poll_transmit());
+    CHECK_EQUAL(uint8_t(3), f.adapter.transmit_attempts());
+    CHECK_EQUAL(mesh::TRANSMIT_SUCCESS, f.adapter.poll_transmit());
+    CHECK((f.radio.last_status & nrf24l01::NRF_STATUS::TX_DS) == 0);
+
+    // A new burst starts clean
+    CHECK(f.start(3));
+    CHECK_EQUAL(mesh::TRANSMIT_PENDING, f.adapter.poll_transmit());
+    f.radio.transmit(1);
+    CHECK_EQUAL(mesh::TRANSMIT_SUCCESS, f.adapter.poll_transmit());
+    CHECK(f.delivered() == std::vector<uint8_t>({1, 2, 3}));
+}
+
+TEST(sent_payloads_are_counted_from_the_fifo_occupancy) {
+    fixture f;
+    CHECK(f.start(1));
+    CHECK(f.start(2));
+
+    // TX_DS with a payload left: exactly one was sent
+    f.radio.transmit(1);
+    CHECK_EQUAL(mesh::TRANSMIT_SUCCESS, f.adapter.poll_transmit());
+    CHECK_EQUAL(mesh::TRANSMIT_PENDING, f.adapter.poll_transmit());
+    CHECK_EQUAL(mesh::TRANSMIT_PENDING, f.adapter.poll_transmit());
+
+    // The TX_DS of the second payload is a new one, since the first was cleared
+    f.radio.transmit(1);
+    CHECK_EQUAL(mesh::TRANSMIT_SUCCESS, f.adapter.poll_transmit());
+    CHECK(f.delivered() == std::vector<uint8_t>({1, 2}));
+}
+
+TEST(max_rt_part_way_through_a_burst) {
+    fixture f;
+    CHECK(f.start(1));
+    CHECK(f.start(2));
+
+    f.radio.transmit(1);
+    f.radio.fail();
+    // The first payload was sent, the second failed
+    CHECK_EQUAL(mesh::TRANSMIT_SUCCESS, f.adapter.poll_transmit());
+    CHECK(!f.start(3)); // Nothing is appended behind a failure
+    CHECK_EQUAL(mesh::TRANSMIT_FAILED, f.adapter.poll_transmit());
+    CHECK_EQUAL(uint8_t(11), f.adapter.transmit_attempts());
+
+    // The failed payload is flushed and MAX_RT cleared, so the module can transmit again
+    CHECK(f.radio.tx_fifo.empty());
+    CHECK((f.radio.last_status & nrf24l01::NRF_STATUS::MAX_RT) == 0);
+    CHECK(f.start(3));
+    f.radio.transmit(1);
+    CHECK_EQUAL(mesh::TRANSMIT_SUCCESS, f.adapter.poll_transmit());
+    CHECK(f.delivered() == std::vector<uint8_t>({1, 3}));
+}
+
+TEST(max_rt_on_the_first_payload_fails_it) {
+    fixture f;
+    CHECK(f.start(1));
+    CHECK(f.start(2));
+
+    f.radio.fail();
+    // The adapter retries the second payload later, it isn't reported here
+    CHECK_EQUAL(mesh::TRANSMIT_FAILED, f.adapter.poll_transmit());
+    CHECK(f.radio.tx_fifo.empty());
+    CHECK(f.delivered().empty());
+}
+
+TEST(transmissions_that_never_finish_time_out) {
+    fixture f;
+    CHECK(f.start(1));
+    hwlib::mock::time_us = 50000;
+    CHECK_EQUAL(mesh::TRANSMIT_PENDING, f.adapter.poll_transmit());
+    hwlib::mock::time_us = 100001;
+    CHECK_EQUAL(mesh::TRANSMIT_FAILED, f.adapter.poll_transmit());
+    CHECK(f.radio.tx_fifo.empty());
+}
+
+TEST(reported_payloads_restart_the_timeout) {
+    fixture f;
+    CHECK(f.start(1));
+    CHECK(f.start(2));
+    hwlib::mock::time_us = 90000;
+    f.radio.transmit(1);
+    CHECK_EQUAL(mesh::TRANSMIT_SUCCESS, f.adapter.poll_transmit());
+    hwlib::mock::time_us = 150000;
+    CHECK_EQUAL(mesh::TRANSMIT_PENDING, f.adapter.poll_transmit());
+    hwlib::mock::time_us = 190001;
+    CHECK_EQUAL(mesh::TRANSMIT_FAILED, f.adapter.poll_transmit());
+}
@@ -0,0 +1,155 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include "test.hpp"
+#include "fake_adapter.hpp"
+#include <mesh/mesh_network.hpp>
+#include <map>
+
+using mesh_test::fake_adapter;
+
+namespace {
+    mesh::message data_message(const mesh::node_id &receiver, uint8_t id) {
+        mesh::message msg(0x30, id, 1, receiver);
+        msg.data[0] = id;
+        msg.dataSize = 1;
+        return msg;
+    }
+
+    /// Router with routes that are set by the test
+    class table_router : public mesh::router {
+        std::map<mesh::node_id, mesh::node_id> next_hops;
+
+    public:
+        using router::router;
+
+        void add_route(const mesh::node_id &destination, const mesh::node_id &next_hop) {
+            next_hops[destination] = next_hop;
+            routes_changed();
+        }
+
+        mesh::node_id get_next_hop(const mesh::node_id &receiver) override {
+            auto route = next_hops.find(receiver);
+            return route == next_hops.end() ? 0 : route->second;
+        }
+    };
+
+    /// Data messages that were sent, with their next hop and receiver
+    std::vector<std::pair<mesh::node_id, mesh::node_id>> sent_data(fake_adapter &adapter) {
+        adapter.drain();
+        std::vector<std::pair<mesh::node_id, mesh::node_id>> result;
+        for (const auto &frame : adapter.sent) {
+            if (frame.type() == 0x30) {
+                result.emplace_back(frame.next_hop, frame.receiver());
+            }
+        }
+        return result;
+    }
+}
+
+TEST(stored_messages_are_kept_oldest_first) {
+    mesh::store_and_forward_pool<3> held(4, 10);
+    CHECK(held.store(data_message(9, 1)));
+    CHECK(held.store(data_message(10, 2)));
+    CHECK(held.store(data_message(9, 3)));
+    CHECK(!held.store(data_message(11, 4)));
+    CHECK_EQUAL(size_t(3), held.get_count());
+    CHECK_EQUAL(uint16_t(1), held.get_dropped_count());
+
+    held.remove(1);
+    CHECK_EQUAL(size_t(2), held.get_count());
+    CHECK_EQUAL(uint8_t(1), held.get(0).data[0]);
+    CHECK_EQUAL(uint8_t(3), held.get(1).data[0]);
+    CHECK(held.store(data_message(11, 4)));
+}
+
+TEST(a_receiver_can_only_use_its_share_of_the_store) {
+    mesh::store_and_forward_pool<8> held(2, 10);
+    CHECK(held.store(data_message(9, 1)));
+    CHECK(held.store(data_message(9, 2)));
+    CHECK(!held.store(data_message(9, 3)));
+    CHECK(held.store(data_message(10, 4)));
+    CHECK_EQUAL(uint16_t(1), held.get_dropped_count());
+
+    held.remove(0);
+    CHECK(held.store(data_message(9, 3)));
+}
+
+TEST(stored_messages_expire_after_their_ttl) {
+    mesh::store_and_forward_pool<4> held(4, 3);
+    CHECK(held.store(data_message(9, 1)));
+    held.tick();
+    held.tick();
+    CHECK(held.store(data_message(9, 2)));
+    held.tick();
+    CHECK_EQUAL(size_t(2), held.get_count());
+
+    // Only the oldest message is past its ttl
+    held.tick();
+    CHECK_EQUAL(size_t(1), held.get_count());
+    CHECK_EQUAL(uint8_t(2), held.get(0).data[0]);
+    CHECK_EQUAL(uint16_t(1), held.get_dropped_count());
+
+    held.tick();
+    held.tick();
+    CHECK_EQUAL(size_t(0), held.get_count());
+    CHECK_EQUAL(uint16_t(2), held.get_dropped_count());
+}
+
+TEST(held_messages_are_sent_once_a_route_is_found) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5, 6};
+    table_router router(adapter);
+    mesh::mesh_network network(adapter, router);
+    mesh::store_and_forward_pool<4> held(4, 100);
+    network.set_store_and_forward(held);
+
+    mesh::message to_9 = data_message(9, 1);
+    mesh::message to_10 = data_message(10, 2);
+    CHECK(network.sendMessage(to_9));
+    CHECK(network.sendMessage(to_10));
+    CHECK_EQUAL(size_t(2), held.get_count());
+    network.update();
+    CHECK(sent_data(adapter).empty());
+
+    // Only the message that has a route now is sent, the other one keeps waiting
+    router.add_route(9, 5);
+    network.update();
+    auto sent = sent_data(adapter);
+    CHECK(sent.size() == 1 && sent[0] == std::make_pair(mesh::node_id(5), mesh::node_id(9)));
+    CHECK_EQUAL(size_t(1), held.get_count());
+    CHECK_EQUAL(mesh::node_id(10), held.get(0).receiver);
+}
+
+TEST(held_messages_without_a_route_are_dropped_after_their_ttl) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5};
+    table_router router(adapter);
+    mesh::mesh_network network(adapter, router);
+    mesh::store_and_forward_pool<4> held(4, 5);
+    network.set_store_and_forward(held);
+
+    mesh::message msg = data_message(9, 1);
+    CHECK(network.sendMessage(msg));
+    for (size_t i = 0; i < 6; i++) {
+        network.update();
+    }
+    CHECK_EQUAL(size_t(0), held.get_count());
+    router.add_route(9, 5);
+    network.update();
+    CHECK(sent_data(adapter).empty());
+}
+
+TEST(without_a_store_unroutable_messages_are_dropped) {
+    fake_adapter adapter(1);
+    table_router router(adapter);
+    mesh::mesh_network network(adapter, router);
+    mesh::message msg = data_message(9, 1);
+    CHECK(!network.sendMessage(msg));
+}
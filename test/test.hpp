@@ -0,0 +1,86 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#ifndef IPASS_MESH_TEST_HPP
+#define IPASS_MESH_TEST_HPP
+
+#include <cstdio>
+
+/**
+ * Minimal unit test support for the host tests, so they don't need a test framework.
+ *
+ * TEST(name) defines a test function, that registers itself to be run by test_main.cpp.
+ * CHECK(condition) and CHECK_EQUAL(expected, actual) report a failure, and let the test continue.
+ */
+namespace mesh_test {
+    /**
+     * \brief A registered test
+     */
+    struct test_case {
+        const char *name;
+        void (*run)();
+        test_case *next;
+    };
+
+    /**
+     * \brief Get the list of registered tests
+     * @return The first test, in order of registration
+     */
+    inline test_case *&first_test() {
+        static test_case *first = nullptr;
+        return first;
+    }
+
+    /**
+     * \brief Get the amount of failed checks
+     * @return The failure count, shared by all tests
+     */
+    inline int &failure_count() {
+        static int count = 0;
+        return count;
+    }
+
+    /**
+     * \brief Adds a test to the end of the list, when it is constructed
+     */
+    struct registration {
+        explicit registration(test_case &test) {
+            test_case **last = &first_test();
+            while (*last != nullptr) {
+                last = &(*last)->next;
+            }
+            *last = &test;
+        }
+    };
+
+    /**
+     * \brief Report a failed check
+     * @param file Source file of the check
+     * @param line Line of the check
+     * @param check Text of the check
+     */
+    inline void fail(const char *file, int line, const char *check) {
+        failure_count()++;
+        printf("  %s:%d: %s failed\n", file, line, check);
+    }
+}
+
+#define TEST(name) \
+    static void name(); \
+    static mesh_test::test_case name##_case = {#name, name, nullptr}; \
+    static mesh_test::registration name##_registration(name##_case); \
+    static void name()
+
+#define CHECK(condition) \
+    ((condition) ? (void) 0 : mesh_test::fail(__FILE__, __LINE__, "CHECK(" #condition ")"))
+
+#define CHECK_EQUAL(expected, actual) \
+    ((expected) == (actual) ? (void) 0 : mesh_test::fail(__FILE__, __LINE__, "CHECK_EQUAL(" #expected ", " #actual ")"))
+
+#endif //IPASS_MESH_TEST_HPP
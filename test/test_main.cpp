@@ -0,0 +1,31 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+/**
+ * Runs all host tests, and exits with 1 if any check failed.
+ */
+
+#include "test.hpp"
+
+int main() {
+    int tests = 0;
+    int failed_tests = 0;
+    for (mesh_test::test_case *test = mesh_test::first_test(); test != nullptr; test = test->next) {
+        int failures_before = mesh_test::failure_count();
+        test->run();
+        bool passed = mesh_test::failure_count() == failures_before;
+        printf("%s %s\n", passed ? "ok    " : "FAILED", test->name);
+        tests++;
+        if (!passed) {
+            failed_tests++;
+        }
+    }
+    printf("%d tests, %d failed\n", tests, failed_tests);
+    return failed_tests == 0 ? 0 : 1;
+}
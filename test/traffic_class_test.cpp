@@ -0,0 +1,115 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include "test.hpp"
+#include "fake_adapter.hpp"
+
+using mesh_test::fake_adapter;
+
+namespace {
+    bool send(fake_adapter &adapter, const mesh::message_type &type, const mesh::node_id &next_hop = 5) {
+        mesh::message msg(type, 0, 1, next_hop);
+        return adapter.send(msg);
+    }
+
+    /// Types of the sent frames, in order
+    std::vector<mesh::message_type> sent_types(fake_adapter &adapter) {
+        adapter.drain();
+        std::vector<mesh::message_type> types;
+        for (const auto &frame : adapter.sent) {
+            types.push_back(frame.type());
+        }
+        return types;
+    }
+
+    /// Keep the first transmission in flight, so the others wait in the queue
+    void hold_transmissions(fake_adapter &adapter) {
+        adapter.results.assign(100, mesh::TRANSMIT_PENDING);
+    }
+
+    void release_transmissions(fake_adapter &adapter) {
+        adapter.results.clear();
+    }
+}
+
+TEST(message_types_map_to_traffic_classes) {
+    fake_adapter adapter(1);
+    CHECK_EQUAL(mesh::CLASS_DISCOVERY, adapter.get_traffic_class(mesh::DISCOVERY::PRESENT));
+    CHECK_EQUAL(mesh::CLASS_ROUTING, adapter.get_traffic_class(mesh::DISTANCE_VECTOR_ROUTING::UPDATE));
+    CHECK_EQUAL(mesh::CLASS_DATA, adapter.get_traffic_class(mesh::TRANSPORT::FRAGMENT));
+    CHECK_EQUAL(mesh::CLASS_DATA, adapter.get_traffic_class(0x30));
+}
+
+TEST(higher_classes_are_sent_first) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5};
+    hold_transmissions(adapter);
+
+    CHECK(send(adapter, 0x30));
+    CHECK(send(adapter, 0x31));
+    CHECK(send(adapter, mesh::DISTANCE_VECTOR_ROUTING::UPDATE));
+    CHECK(send(adapter, 0x32));
+    CHECK(send(adapter, mesh::DISCOVERY::NO_OPERATION));
+    CHECK(send(adapter, mesh::DISTANCE_VECTOR_ROUTING::UPDATE_REQUEST));
+    CHECK_EQUAL(size_t(1), adapter.get_queued_count(mesh::CLASS_DISCOVERY));
+    CHECK_EQUAL(size_t(2), adapter.get_queued_count(mesh::CLASS_ROUTING));
+    CHECK_EQUAL(size_t(3), adapter.get_queued_count(mesh::CLASS_DATA));
+
+    // The message in flight finishes first, then the rest go by class, and in order within a class
+    release_transmissions(adapter);
+    CHECK(sent_types(adapter) == std::vector<mesh::message_type>(
+            {0x30, mesh::DISCOVERY::NO_OPERATION, mesh::DISTANCE_VECTOR_ROUTING::UPDATE,
+             mesh::DISTANCE_VECTOR_ROUTING::UPDATE_REQUEST, 0x31, 0x32}));
+}
+
+TEST(a_full_data_queue_doesnt_hold_back_other_classes) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5};
+    hold_transmissions(adapter);
+
+    for (size_t i = 0; i < mesh::connectivity_adapter::class_queue_size; i++) {
+        CHECK(send(adapter, 0x30));
+    }
+    CHECK(!send(adapter, 0x30));
+    CHECK(send(adapter, mesh::DISTANCE_VECTOR_ROUTING::UPDATE));
+    CHECK(send(adapter, mesh::DISCOVERY::NO_OPERATION));
+
+    release_transmissions(adapter);
+    std::vector<mesh::message_type> types = sent_types(adapter);
+    CHECK_EQUAL(mesh::connectivity_adapter::class_queue_size + 2, types.size());
+    CHECK(types.size() > 2 && types[1] == mesh::DISCOVERY::NO_OPERATION &&
+          types[2] == mesh::DISTANCE_VECTOR_ROUTING::UPDATE);
+}
+
+TEST(the_class_of_a_type_can_be_changed) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5};
+    CHECK(adapter.set_traffic_class(0x40, mesh::CLASS_ROUTING));
+    CHECK_EQUAL(mesh::CLASS_ROUTING, adapter.get_traffic_class(0x40));
+
+    hold_transmissions(adapter);
+    CHECK(send(adapter, 0x30));
+    CHECK(send(adapter, 0x31));
+    CHECK(send(adapter, 0x40));
+    release_transmissions(adapter);
+    CHECK(sent_types(adapter) == std::vector<mesh::message_type>({0x30, 0x40, 0x31}));
+}
+
+TEST(the_amount_of_class_changes_is_limited) {
+    fake_adapter adapter(1);
+    for (size_t i = 0; i < mesh::connectivity_adapter::max_class_overrides; i++) {
+        CHECK(adapter.set_traffic_class(mesh::message_type(0x40 + i), mesh::CLASS_ROUTING));
+    }
+    CHECK(!adapter.set_traffic_class(0x50, mesh::CLASS_ROUTING));
+    CHECK_EQUAL(mesh::CLASS_DATA, adapter.get_traffic_class(0x50));
+
+    // Types that already have an override can still be changed
+    CHECK(adapter.set_traffic_class(0x40, mesh::CLASS_DISCOVERY));
+    CHECK_EQUAL(mesh::CLASS_DISCOVERY, adapter.get_traffic_class(0x40));
+}
@@ -0,0 +1,131 @@
+/*
+ *
+ * Copyright Niels Post 2019.
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ * https://www.boost.org/LICENSE_1_0.txt)
+ *
+*/
+
+#include "test.hpp"
+#include "fake_adapter.hpp"
+
+using mesh_test::fake_adapter;
+
+namespace {
+    bool send(fake_adapter &adapter, const mesh::message_type &type, const mesh::node_id &next_hop,
+              const mesh::node_id &backup_hop = 0) {
+        mesh::message msg(type, 0, 1, next_hop);
+        return adapter.send(msg, next_hop, backup_hop);
+    }
+
+    size_t report_count(const fake_adapter &adapter, const mesh::node_id &next_hop, bool success) {
+        size_t count = 0;
+        for (const auto &report : adapter.reports) {
+            if (report.next_hop == next_hop && report.success == success) {
+                count++;
+            }
+        }
+        return count;
+    }
+}
+
+TEST(failed_transmissions_are_retried_with_increasing_waits) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5};
+    adapter.results = {mesh::TRANSMIT_FAILED, mesh::TRANSMIT_FAILED, mesh::TRANSMIT_FAILED};
+
+    CHECK(send(adapter, 0x30, 5));
+    CHECK_EQUAL(size_t(1), adapter.sent.size());
+
+    // Poll numbers at which each attempt was started
+    std::vector<size_t> started;
+    for (size_t poll = 1; poll <= 20 && adapter.is_transmitting(); poll++) {
+        size_t before = adapter.sent.size();
+        adapter.poll();
+        if (adapter.sent.size() > before) {
+            started.push_back(poll);
+        }
+    }
+    CHECK(started == std::vector<size_t>({2, 5, 9}));
+    CHECK_EQUAL(size_t(1), adapter.reports.size());
+    CHECK(adapter.reports[0].success);
+}
+
+TEST(an_unreachable_next_hop_fails_all_its_messages) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5, 6};
+    adapter.unreachable = {5};
+
+    CHECK(send(adapter, 0x30, 5));
+    CHECK(send(adapter, 0x31, 5));
+    CHECK(send(adapter, 0x32, 5));
+    CHECK(send(adapter, 0x33, 6));
+    adapter.drain();
+    CHECK(!adapter.is_transmitting());
+
+    // Only the first message is attempted, the others are dropped with it
+    size_t attempts = 0;
+    for (const auto &transmission : adapter.sent) {
+        if (transmission.next_hop == 5) {
+            CHECK_EQUAL(mesh::message_type(0x30), transmission.type());
+            attempts++;
+        }
+    }
+    CHECK_EQUAL(size_t(mesh::connectivity_adapter::max_transmit_attempts), attempts);
+    CHECK_EQUAL(size_t(3), report_count(adapter, 5, false));
+    CHECK_EQUAL(size_t(1), report_count(adapter, 6, true));
+
+    // The next hop is tried again for new messages
+    adapter.unreachable.clear();
+    CHECK(send(adapter, 0x34, 5));
+    adapter.drain();
+    CHECK_EQUAL(size_t(1), report_count(adapter, 5, true));
+}
+
+TEST(messages_fail_over_to_their_backup_hop) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5, 6};
+    adapter.unreachable = {5};
+
+    mesh::message msg(0x30, 0, 1, 9);
+    CHECK(adapter.send(msg, 5, 6));
+    adapter.drain();
+
+    CHECK_EQUAL(size_t(mesh::connectivity_adapter::max_transmit_attempts + 1), adapter.sent.size());
+    CHECK_EQUAL(mesh::node_id(6), adapter.sent.back().next_hop);
+    CHECK_EQUAL(mesh::node_id(9), adapter.sent.back().receiver());
+    // The failure of the first next hop is still reported
+    CHECK_EQUAL(size_t(1), report_count(adapter, 5, false));
+    CHECK_EQUAL(size_t(1), report_count(adapter, 6, true));
+}
+
+TEST(losing_a_backup_hop_keeps_the_message) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {5, 6};
+    adapter.unreachable = {5, 6};
+
+    CHECK(send(adapter, 0x30, 5));
+    CHECK(send(adapter, 0x31, 6, 5));
+    adapter.drain();
+
+    // The first message gives up on 5 first. The second one only loses its backup hop then, so it isn't tried on 5
+    CHECK_EQUAL(size_t(1), report_count(adapter, 5, false));
+    CHECK_EQUAL(size_t(1), report_count(adapter, 6, false));
+    for (const auto &transmission : adapter.sent) {
+        if (transmission.type() == 0x31) {
+            CHECK_EQUAL(mesh::node_id(6), transmission.next_hop);
+        }
+    }
+}
+
+TEST(unusable_next_hops_are_replaced_by_the_backup_hop) {
+    fake_adapter adapter(1);
+    adapter.neighbours = {6};
+
+    mesh::message msg(0x30, 0, 1, 9);
+    CHECK(adapter.send(msg, 5, 6));
+    CHECK_EQUAL(mesh::node_id(6), adapter.sent.back().next_hop);
+    CHECK(!adapter.send(msg, 5, 7));
+    CHECK(!adapter.send(msg, 5));
+}